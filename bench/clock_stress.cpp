@@ -0,0 +1,82 @@
+// 时钟序号锁压力测试: 一个写线程模拟音频输出不断设置时钟, 多个读线程同时读取, 检查不会读到撕裂的值
+//
+// 用法: clock_stress [读线程数] [时长(秒)]
+//   写线程以set(v, -v)设置时钟, 每次写入的pts与ptsDrift满足ptsDrift == 2 * pts;
+//   读到不满足此关系的快照, 说明读到了两次写入各一半的字段; get()在单个读线程内应不减
+//   发现撕裂时返回1, 否则返回0
+#include "MediaClock.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_READERS 4     // 默认读线程数
+#define DEFAULT_DURATION_S 2  // 默认运行时长
+#define MAX_REPORTED_TEARS 10 // 最多打印的撕裂次数
+
+int main(int argc, char *argv[])
+{
+    int readers = argc > 1 ? std::atoi(argv[1]) : DEFAULT_READERS;
+    int durationS = argc > 2 ? std::atoi(argv[2]) : DEFAULT_DURATION_S;
+    if (readers <= 0 || durationS <= 0)
+    {
+        std::fprintf(stderr, "usage: clock_stress [readers] [seconds]\n");
+        return 2;
+    }
+
+    Clock clock;
+    std::atomic<bool> running{true};
+    std::atomic<int64_t> writes{0};
+    std::atomic<int64_t> reads{0};
+    std::atomic<int64_t> tears{0};
+
+    // 写入值为整数, 换算为double后2 * pts无舍入误差, 可直接比较
+    std::thread writer([&]()
+                       {
+        double v = 0.0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            v += 1.0;
+            clock.set(v, -v);
+            writes.fetch_add(1, std::memory_order_relaxed);
+        } });
+
+    std::vector<std::thread> readerThreads;
+    for (int i = 0; i < readers; i++)
+    {
+        readerThreads.emplace_back([&]()
+                                   {
+            int64_t count = 0;
+            double lastGet = -INFINITY;
+            while (running.load(std::memory_order_relaxed))
+            {
+                Clock::Snapshot snap = clock.snapshot();
+                bool torn = !std::isnan(snap.pts) && (snap.ptsDrift != 2.0 * snap.pts || snap.paused);
+                // 时钟值为2 * pts + 当前时间, pts只增不减, 读到的值也应不减
+                double value = clock.get();
+                if (!std::isnan(value))
+                {
+                    torn = torn || value < lastGet;
+                    lastGet = value;
+                }
+                if (torn && tears.fetch_add(1, std::memory_order_relaxed) < MAX_REPORTED_TEARS)
+                    std::fprintf(stderr, "torn read: pts=%.0f drift=%.0f paused=%d get=%.3f\n",
+                                 snap.pts, snap.ptsDrift, snap.paused ? 1 : 0, value);
+                count++;
+            }
+            reads.fetch_add(count, std::memory_order_relaxed); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(durationS));
+    running = false;
+    writer.join();
+    for (auto &thread : readerThreads)
+        thread.join();
+
+    std::printf("{\"readers\": %d, \"writes\": %lld, \"reads\": %lld, \"tears\": %lld}\n", readers,
+                static_cast<long long>(writes.load()), static_cast<long long>(reads.load()), static_cast<long long>(tears.load()));
+    return tears.load() == 0 ? 0 : 1;
+}
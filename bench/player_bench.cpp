@@ -0,0 +1,432 @@
+// 无界面解码性能测试: 以空音频/视频输出驱动Decoder完整流水线(解复用, 音视频解码, 格式转换, 同步输出),
+// 输出各阶段吞吐, 耗时分位数与队列深度(JSON), 用于无显示的CI机器上对比不同构建
+//
+// 用法: player_bench [--mode realtime|fast] [--probe fast|full] [--no-probe-cache] [--duration 秒] [--output 文件] <媒体文件>
+//   realtime: 按外部时钟实时输出, 考察实际播放时的负载与输出节奏
+//   fast:     不等待时钟, 输出端取到即丢弃, 考察流水线最大吞吐
+//   --probe/--no-probe-cache: 打开媒体时的探测方式, 结果中的open记录打开耗时与参数来源
+//   --seeks N [--seek-mode exact|keyframe|scrub]: 播放开始后依次跳转到均匀分布的N个位置, 每次等跳转后首帧输出再跳下一次,
+//                                                 结果中的seek为跳转延迟(投递命令到首帧输出); 分别用短GOP与长GOP的文件运行以对比
+//                                                 scrub为暂停后拖动预览, 只解码目标之前最近的关键帧
+#include "MediaClock.h"
+#include "PipelineStats.h"
+#include "PlayerControl.h"
+#include "TraceWriter.h"
+#include "VideoWaiter.h"
+#include "decode.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+
+#define AUDIO_SAMPLE_BYTES 2          // 解码输出为S16
+#define AUDIO_RING_DURATION_S 1       // 环形缓冲时长, 需大于解码超前写入的时长
+#define AUDIO_SINK_INTERVAL_MS 1      // 空音频输出消费数据的间隔
+#define SEEK_POLL_INTERVAL_MS 1       // 跳转测试检查跳转是否完成的间隔
+#define SEEK_TIMEOUT_MS 10000         // 单次跳转超过此时长未输出首帧视为超时
+
+// 空音频输出: 按协商的格式分配环形缓冲并消费数据, 实时模式下按采样率限速
+class NullAudioSink : public QObject
+{
+    Q_OBJECT
+public slots:
+    void onInitAudioOutput(int sampleRate, int channels)
+    {
+        ringBuffer->reset();
+        bytesPerMs = 0.0;
+        if (sampleRate <= 0 || channels <= 0)
+            return;
+
+        frameBytes = channels * AUDIO_SAMPLE_BYTES;
+        bytesPerMs = sampleRate * frameBytes / 1000.0;
+        ringBuffer->allocate(static_cast<size_t>(sampleRate) * frameBytes * AUDIO_RING_DURATION_S);
+        startMs = -1.0;
+
+        if (timer == nullptr)
+        {
+            timer = new QTimer(this);
+            timer->setTimerType(Qt::PreciseTimer);
+            connect(timer, &QTimer::timeout, this, &NullAudioSink::consume);
+        }
+        timer->start(AUDIO_SINK_INTERVAL_MS);
+    }
+
+    // 在音频线程中停止消费, 退出前调用
+    void stop()
+    {
+        delete timer;
+        timer = nullptr;
+    }
+
+private slots:
+    void consume()
+    {
+        size_t available = ringBuffer->availableToRead();
+        if (available == 0 || bytesPerMs <= 0)
+            return;
+
+        if (realtime)
+        { // 首次取到数据时开始计时, 之后累计可播放的字节数不超过经过的时长
+            double now = Clock::nowMs();
+            if (startMs < 0)
+                startMs = now;
+            double budget = (now - startMs) * bytesPerMs - consumedInRun;
+            size_t allowed = budget > 0 ? static_cast<size_t>(budget) / frameBytes * frameBytes : 0;
+            available = qMin(available, allowed);
+        }
+
+        size_t remaining = available;
+        while (remaining > 0)
+        {
+            size_t contiguous = 0;
+            ringBuffer->peek(&contiguous);
+            size_t n = qMin(remaining, contiguous);
+            if (n == 0)
+                break;
+            ringBuffer->consume(n);
+            remaining -= n;
+        }
+        consumedInRun += available - remaining;
+        consumedBytes += available - remaining;
+    }
+
+private:
+    AudioRingBuffer *ringBuffer;
+    bool realtime;
+    QTimer *timer{nullptr};
+    double bytesPerMs{0.0};
+    int frameBytes{AUDIO_SAMPLE_BYTES};
+    double startMs{-1.0};
+    double consumedInRun{0.0};
+
+public:
+    NullAudioSink(AudioRingBuffer *ringBuffer, bool realtime) : ringBuffer(ringBuffer), realtime(realtime) {}
+
+    std::atomic<int64_t> consumedBytes{0};
+};
+
+static QJsonObject histogramToJson(const Histogram &histogram)
+{
+    QJsonObject obj;
+    obj["count"] = static_cast<qint64>(histogram.count());
+    obj["p50"] = static_cast<qint64>(histogram.percentile(50));
+    obj["p90"] = static_cast<qint64>(histogram.percentile(90));
+    obj["p99"] = static_cast<qint64>(histogram.percentile(99));
+    obj["max"] = static_cast<qint64>(histogram.max());
+    obj["mean"] = histogram.mean();
+    return obj;
+}
+
+static QJsonObject stageToJson(PipelineStats::STAGE stage, double wallMs)
+{
+    PipelineStats *stats = PipelineStats::instance();
+    int64_t items = stats->getItems(stage);
+    int64_t bytes = stats->getBytes(stage);
+    double busyMs = stats->getBusyMs(stage);
+
+    // 按墙钟时间的吞吐为实际达到的速度; 按阶段累计耗时的吞吐为该阶段单独运行时的能力上限
+    QJsonObject obj;
+    obj["items"] = static_cast<qint64>(items);
+    obj["bytes"] = static_cast<qint64>(bytes);
+    obj["busy_ms"] = busyMs;
+    obj["fps"] = wallMs > 0 ? items * 1000.0 / wallMs : 0.0;
+    obj["mb_per_s"] = wallMs > 0 ? bytes / 1000.0 / wallMs : 0.0;
+    obj["busy_fps"] = busyMs > 0 ? items * 1000.0 / busyMs : 0.0;
+    obj["busy_mb_per_s"] = busyMs > 0 ? bytes / 1000.0 / busyMs : 0.0;
+    obj["latency_us"] = histogramToJson(stats->getLatency(stage));
+    return obj;
+}
+
+static QJsonObject stagesToJson(double wallMs)
+{
+    QJsonObject stages;
+    for (int i = 0; i < PipelineStats::STAGE_COUNT; i++)
+    {
+        PipelineStats::STAGE stage = static_cast<PipelineStats::STAGE>(i);
+        stages[PipelineStats::stageName(stage)] = stageToJson(stage, wallMs);
+    }
+    return stages;
+}
+
+static QJsonObject depthsToJson()
+{
+    QJsonObject depths;
+    for (int i = 0; i < PipelineStats::DEPTH_COUNT; i++)
+    {
+        PipelineStats::DEPTH depth = static_cast<PipelineStats::DEPTH>(i);
+        depths[PipelineStats::depthName(depth)] = histogramToJson(PipelineStats::instance()->getDepth(depth));
+    }
+    return depths;
+}
+
+static QJsonObject videoToJson(Decoder *decoder, VideoWaiter *videoSink, int64_t presentedFrames, double wallMs)
+{
+    VideoDecoder *videoDecoder = decoder->getVideoDecoder();
+    QJsonObject video;
+    video["presented"] = static_cast<qint64>(presentedFrames);
+    video["fps"] = wallMs > 0 ? presentedFrames * 1000.0 / wallMs : 0.0;
+    video["dropped_presenter"] = static_cast<qint64>(videoSink->getDroppedFrames());
+    video["dropped_decoder"] = static_cast<qint64>(videoDecoder->getDroppedLateFrames());
+    video["skipped_decoder"] = static_cast<qint64>(videoDecoder->getSkippedFrames());
+    video["lateness_us"] = histogramToJson(videoSink->getLatenessHistogram());
+    return video;
+}
+
+// 依次投递跳转(或预览)命令, 上一次跳转的首帧输出(STAGE_SEEK或STAGE_SCRUB计数增加)或超时后再投递下一次
+class SeekDriver : public QObject
+{
+    Q_OBJECT
+private:
+    Decoder *decoder;
+    PlayerControl *control;
+    int64_t mediaDurationMs;
+    PLAYER_COMMAND command; // CMD_SEEK或CMD_SCRUB
+    QTimer timer;
+    double issuedMs{0.0};
+    bool waiting{false};
+
+public:
+    const int requested;
+    int issued{0};
+    int timeouts{0};
+
+    SeekDriver(Decoder *decoder, PlayerControl *control, int64_t mediaDurationMs, int requested, PLAYER_COMMAND command)
+        : decoder(decoder), control(control), mediaDurationMs(mediaDurationMs), command(command), requested(requested)
+    {
+        timer.setTimerType(Qt::PreciseTimer);
+        connect(&timer, &QTimer::timeout, this, &SeekDriver::poll);
+        timer.start(SEEK_POLL_INTERVAL_MS);
+    }
+
+    PipelineStats::STAGE stage() const { return command == CMD_SCRUB ? PipelineStats::STAGE_SCRUB : PipelineStats::STAGE_SEEK; }
+    int completed() const { return static_cast<int>(PipelineStats::instance()->getItems(stage())); }
+
+private slots:
+    void poll()
+    {
+        if (waiting)
+        {
+            if (completed() + timeouts >= issued)
+                waiting = false;
+            else if (Clock::nowMs() - issuedMs > SEEK_TIMEOUT_MS)
+            {
+                timeouts++;
+                waiting = false;
+            }
+            else
+                return;
+        }
+        if (issued == requested)
+        {
+            timer.stop();
+            QCoreApplication::quit();
+            return;
+        }
+
+        // 目标均匀分布在全片, 一般不落在关键帧上
+        issued++;
+        int64_t target = mediaDurationMs * issued / (requested + 1);
+        issuedMs = Clock::nowMs();
+        waiting = true;
+        if (command == CMD_SCRUB && issued == 1)
+            control->post(CMD_PAUSE); // 预览只在暂停时执行
+        control->post(command, target);
+        QMetaObject::invokeMethod(decoder, "processCommands", Qt::QueuedConnection);
+    }
+};
+
+static QJsonObject seekToJson(Decoder *decoder, const SeekDriver *seekDriver, const QString &seekMode)
+{
+    QJsonObject seek;
+    seek["mode"] = seekMode;
+    seek["requested"] = seekDriver->requested;
+    seek["completed"] = seekDriver->completed();
+    seek["timeouts"] = seekDriver->timeouts;
+    seek["discarded_frames"] = static_cast<qint64>(decoder->getVideoDecoder()->getSeekDiscardedFrames());
+    seek["latency_us"] = histogramToJson(PipelineStats::instance()->getLatency(seekDriver->stage()));
+    return seek;
+}
+
+static QJsonObject audioToJson(Decoder *decoder, NullAudioSink *audioSink)
+{
+    QJsonObject audio;
+    audio["consumed_bytes"] = static_cast<qint64>(audioSink->consumedBytes);
+    audio["overruns"] = static_cast<qint64>(decoder->getAudioRingBuffer()->getOverruns());
+    return audio;
+}
+
+// fileName为空时写到标准输出
+static bool writeJson(const QByteArray &json, const QString &fileName)
+{
+    QFile file(fileName);
+    bool opened = fileName.isEmpty() ? file.open(stdout, QIODevice::WriteOnly) : file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!opened || file.write(json) != json.size())
+    {
+        qCritical() << "cannot write" << (fileName.isEmpty() ? QString("stdout") : fileName);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("player_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless decode pipeline benchmark");
+    parser.addHelpOption();
+    QCommandLineOption modeOption("mode", "realtime or fast (default fast).", "mode", "fast");
+    QCommandLineOption durationOption("duration", "Stop after this many seconds (0 = until end).", "seconds", "0");
+    QCommandLineOption outputOption("output", "Write JSON to this file instead of stdout.", "file");
+    QCommandLineOption probeOption("probe", "Stream probing: fast or full (default fast).", "probe", "fast");
+    QCommandLineOption noProbeCacheOption("no-probe-cache", "Do not read or write the probe cache.");
+    parser.addOption(modeOption);
+    QCommandLineOption seeksOption("seeks", "Seek this many times instead of playing through (0 = no seeks).", "count", "0");
+    QCommandLineOption seekModeOption("seek-mode", "exact, keyframe or scrub (default exact).", "mode", "exact");
+    parser.addOption(probeOption);
+    parser.addOption(noProbeCacheOption);
+    parser.addOption(seeksOption);
+    parser.addOption(seekModeOption);
+    parser.addOption(durationOption);
+    parser.addOption(outputOption);
+    parser.addPositionalArgument("media", "Media file to decode.");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    QString mode = parser.value(modeOption);
+    QString probe = parser.value(probeOption);
+    QString seekMode = parser.value(seekModeOption);
+    int seekCount = parser.value(seeksOption).toInt();
+    if (args.size() != 1 || (mode != "realtime" && mode != "fast") || (probe != "fast" && probe != "full") ||
+        (seekMode != "exact" && seekMode != "keyframe" && seekMode != "scrub") || seekCount < 0)
+        parser.showHelp(1);
+    bool realtime = mode == "realtime";
+    double durationS = parser.value(durationOption).toDouble();
+
+    TraceWriter::instance()->startFromEnvironment();
+
+    PlayerControl control;
+    Decoder *decoder = new Decoder(&control);
+    QThread decodeThread;
+    decodeThread.setObjectName("decoder");
+    decoder->moveToThread(&decodeThread);
+    decodeThread.start();
+
+    NullAudioSink *audioSink = new NullAudioSink(decoder->getAudioRingBuffer(), realtime);
+    QThread audioThread;
+    audioThread.setObjectName("audio_output");
+    audioSink->moveToThread(&audioThread);
+    audioThread.start(QThread::HighPriority);
+    QObject::connect(decoder, &Decoder::initAudioOutput, audioSink, &NullAudioSink::onInitAudioOutput, Qt::BlockingQueuedConnection);
+
+    // 视频经VideoWaiter输出, 与播放器相同的取帧/等待/丢帧逻辑, 帧在输出线程内直接释放
+    VideoWaiter *videoSink = new VideoWaiter(decoder->getVideoFrameQueue(), decoder->getMediaClock(), &control);
+    videoSink->setAsFastAsPossible(!realtime);
+    QThread videoThread;
+    videoThread.setObjectName("video_present");
+    videoSink->moveToThread(&videoThread);
+    videoThread.start();
+    std::atomic<int64_t> presentedFrames{0};
+    QObject::connect(decoder, &Decoder::startPlay, videoSink, &VideoWaiter::presentLoop);
+    QObject::connect(decoder, &Decoder::initClock, videoSink, &VideoWaiter::onInitClock);
+    QObject::connect(decoder->getVideoDecoder(), &VideoDecoder::scrubFrameReady, videoSink, &VideoWaiter::onScrubFrame);
+    QObject::connect(
+        videoSink, &VideoWaiter::sendFrame, videoSink, [&presentedFrames](AVFrame *frame)
+        {
+            TraceWriter::asyncEnd("queued_signal", frame);
+            presentedFrames++;
+            av_frame_free(&frame); },
+        Qt::DirectConnection);
+
+    // 无音频设备时钟, 音视频都跟随外部时钟
+    decoder->getMediaClock()->setSyncMaster(MediaClock::EXTERNAL_MASTER);
+    decoder->setProbeMode(probe == "fast" ? Decoder::PROBE_FAST : Decoder::PROBE_FULL);
+    decoder->setProbeCacheEnabled(!parser.isSet(noProbeCacheOption));
+    decoder->setExactSeek(seekMode == "exact");
+    decoder->setVideoPath(args.first());
+    int64_t mediaDurationMs = decoder->getDuration();
+
+    int exitCode = 0;
+    if (mediaDurationMs < 0)
+    {
+        qCritical() << "failed to open" << args.first();
+        exitCode = 2;
+    }
+    else
+    {
+        // 所有在用流都解码到结尾(或到达限定时长)时结束
+        Decoder::FFMPEG_MEDIA_TYPE mediaType = decoder->getMediaType();
+        int remainingStreams = 0;
+        auto onStreamEnd = [&remainingStreams]()
+        {
+            if (--remainingStreams == 0)
+                QCoreApplication::quit();
+        };
+        if (mediaType != Decoder::ONLY_VIDEO)
+        {
+            remainingStreams++;
+            QObject::connect(decoder->getAudioDecoder(), &AudioDecoder::decodeEnd, &app, onStreamEnd, Qt::QueuedConnection);
+        }
+        if (mediaType != Decoder::ONLY_AUDIO)
+        {
+            remainingStreams++;
+            QObject::connect(decoder->getVideoDecoder(), &VideoDecoder::decodeEnd, &app, onStreamEnd, Qt::QueuedConnection);
+        }
+        if (durationS > 0)
+            QTimer::singleShot(static_cast<int>(durationS * 1000), &app, &QCoreApplication::quit);
+
+        PipelineStats::instance()->reset();
+        double startMs = Clock::nowMs();
+        control.post(CMD_PLAY);
+        QMetaObject::invokeMethod(decoder, "processCommands", Qt::QueuedConnection);
+        SeekDriver *seekDriver = seekCount > 0 ? new SeekDriver(decoder, &control, mediaDurationMs, seekCount, seekMode == "scrub" ? CMD_SCRUB : CMD_SEEK) : nullptr;
+        app.exec();
+        double wallMs = Clock::nowMs() - startMs;
+
+        // 先停止输出再统计, 避免统计过程中计数继续变化
+        control.stop();
+
+        QJsonObject result;
+        result["media"] = args.first();
+        result["mode"] = mode;
+        result["media_duration_ms"] = static_cast<qint64>(mediaDurationMs);
+        result["wall_ms"] = wallMs;
+        QJsonObject open;
+        open["ms"] = decoder->getOpenMs();
+        open["probe"] = decoder->getProbeResult();
+        result["open"] = open;
+        result["stages"] = stagesToJson(wallMs);
+        result["queue_depths"] = depthsToJson();
+        result["video"] = videoToJson(decoder, videoSink, presentedFrames, wallMs);
+        result["audio"] = audioToJson(decoder, audioSink);
+        if (seekDriver)
+            result["seek"] = seekToJson(decoder, seekDriver, seekMode);
+        delete seekDriver;
+        if (!writeJson(QJsonDocument(result).toJson(QJsonDocument::Indented), parser.value(outputOption)))
+            exitCode = 3;
+    }
+
+    // 释放解码器时中止各队列并等待各循环退出, 之后输出线程才能结束
+    decodeThread.quit();
+    decodeThread.wait();
+    delete decoder;
+
+    videoThread.quit();
+    videoThread.wait();
+    delete videoSink;
+
+    QMetaObject::invokeMethod(audioSink, "stop", Qt::BlockingQueuedConnection);
+    audioThread.quit();
+    audioThread.wait();
+    delete audioSink;
+
+    TraceWriter::instance()->stop();
+    return exitCode;
+}
+
+#include "player_bench.moc"
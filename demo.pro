@@ -19,22 +19,53 @@ HEADERS +=              \
     src/demo.h          \
     src/CMediaDialog.h  \
     src/Decode.h        \
+    src/Demuxer.h       \
+    src/FrameQueue.h    \
+    src/FrameBufferPool.h \
+    src/GopCache.h      \
+    src/PacketQueue.h   \
     src/AudioRenderer.h \
+    src/AudioRingBuffer.h \
+    src/MediaClock.h    \
     src/VideoWaiter.h   \
+    src/FrameScheduler.h \
+    src/Histogram.h     \
+    src/PipelineStats.h \
+    src/ProbeCache.h    \
+    src/KeyframeIndex.h \
+    src/ThumbnailCache.h \
+    src/TraceWriter.h   \
     src/OpenGLWidget.h  \
+    src/PlayerControl.h \
     src/playerCommand.h \
 
 SOURCES +=                  \
     src/demo.cpp            \
     src/CMediaDialog.cpp    \
     src/Decode.cpp          \
+    src/Demuxer.cpp         \
+    src/FrameQueue.cpp      \
+    src/FrameBufferPool.cpp \
+    src/GopCache.cpp        \
+    src/PacketQueue.cpp     \
     src/AudioRenderer.cpp   \
+    src/AudioRingBuffer.cpp \
+    src/MediaClock.cpp      \
     src/VideoWaiter.cpp     \
+    src/FrameScheduler.cpp  \
+    src/Histogram.cpp       \
+    src/PipelineStats.cpp   \
+    src/ProbeCache.cpp      \
+    src/KeyframeIndex.cpp   \
+    src/ThumbnailCache.cpp  \
+    src/TraceWriter.cpp     \
     src/OpenGLWidget.cpp    \
+    src/PlayerControl.cpp   \
     src/main.cpp            \
 
 # $$PWD 表示pro文件的当前路径
 LIBS += $$PWD/lib/ffmpeg/lib/*.lib
+win32: LIBS += -lwinmm # timeBeginPeriod, 提高定时器精度
 INCLUDEPATH += $$PWD/lib/ffmpeg/include
 DEPENDPATH += $$PWD/lib/ffmpeg/include
 
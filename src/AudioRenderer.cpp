@@ -1,12 +1,34 @@
 #include "AudioRenderer.h"
-#include <QThread>
+#include "PipelineStats.h"
+#include "playerCommand.h"
+#include <QDebug>
+#include <cmath>
+#include <cstring>
 
-#define SAMPLE_SIZE 16 // 采样位数/位深
-#define MAX_AUDIO_FRAME_SIZE 192000
+#define SAMPLE_SIZE 16           // 采样位数/位深
+#define RING_BUFFER_DURATION_S 1 // 环形缓冲可缓存的时长
+#define DEVICE_BUFFER_MS 100     // 音频设备缓冲时长
+
+qint64 AudioOutputDevice::readData(char *data, qint64 maxSize)
+{
+    return renderer->pullAudioData(data, maxSize);
+}
+
+qint64 AudioOutputDevice::bytesAvailable() const
+{
+    return static_cast<qint64>(renderer->ringBuffer->availableToRead()) + QIODevice::bytesAvailable();
+}
 
 void AudioRenderer::onInitAudioOutput(int sampleRate, int channels)
 {
     clean();
+    ringBuffer->reset();
+    if (sampleRate <= 0 || channels <= 0) // 媒体无音频流
+        return;
+
+    // 解码线程已停止, 此时可安全地重新分配
+    ringBuffer->allocate(sampleRate * channels * (SAMPLE_SIZE / 8) * RING_BUFFER_DURATION_S);
+    bytesPerMs = sampleRate * channels * (SAMPLE_SIZE / 8) / 1000.0;
 
     QAudioFormat format;
     format.setSampleRate(sampleRate);
@@ -14,65 +36,177 @@ void AudioRenderer::onInitAudioOutput(int sampleRate, int channels)
     format.setSampleSize(SAMPLE_SIZE);
     format.setCodec("audio/pcm");
     format.setByteOrder(QAudioFormat::LittleEndian);
-    format.setSampleType(QAudioFormat::UnSignedInt);
+    format.setSampleType(QAudioFormat::SignedInt); // 重采样输出为AV_SAMPLE_FMT_S16, 补静音时填0
 
+    // 拉模式: 音频后端按需从outputDevice读取, 本线程不再等待设备空闲
     audioOutput = new QAudioOutput(format);
-    outputDevice = audioOutput->start();
+    audioOutput->setBufferSize(static_cast<int>(bytesPerMs * DEVICE_BUFFER_MS));
+    outputDevice = new AudioOutputDevice(this);
+    outputDevice->open(QIODevice::ReadOnly);
+    audioOutput->start(outputDevice);
 }
 
-void AudioRenderer::onGetAudioClock(double &pts) const
+void AudioRenderer::clean()
+{
+    if (audioOutput)
+    {
+        audioOutput->stop();
+        audioOutput->deleteLater();
+        audioOutput = nullptr;
+    }
+    if (outputDevice)
+    {
+        qDebug() << "audio underruns: " << ringBuffer->getUnderruns() << "overruns: " << ringBuffer->getOverruns();
+        outputDevice->close();
+        outputDevice->deleteLater();
+        outputDevice = nullptr;
+    }
+    ptsAnchors.clear();
+    announcedBytes = 0;
+    flushSerial = 0;
+    primed = false;
+    deviceSegments.clear();
+    deviceBytes = 0;
+    lastPtsSeconds = 0;
+    mediaClock->audio().reset();
+}
+
+void AudioRenderer::recvAudioBuffer(int bufferSize, double pts_ms, int serial)
 {
     if (audioOutput == nullptr)
+    { // 无输出设备时丢弃, 避免环形缓冲写满阻塞解码
+        ringBuffer->consume(qMin(static_cast<size_t>(bufferSize), ringBuffer->availableToRead()));
         return;
+    }
 
-    pts = curPtsMs;
+    // 通知与写入顺序一致, 累计字节数即为该块在环形缓冲中的起始位置
+    uint64_t bytePos = announcedBytes;
+    announcedBytes += bufferSize;
+    if (serial < flushSerial)
+    { // 跳转前写入, 通知晚于清空到达, 之前的数据已在清空时跳过
+        skipTo(announcedBytes);
+        return;
+    }
+    ptsAnchors.enqueue({bytePos, pts_ms, serial});
 }
 
-inline void AudioRenderer::outputAudioFrame(uint8_t *audioBuffer, int bufferSize)
+void AudioRenderer::onFlushAudio(int serial)
 {
-    if (audioOutput == nullptr)
-        return;
+    // 已通知的跳转前数据直接跳过; 之后才到达的跳转前通知在recvAudioBuffer中跳过
+    flushSerial = serial;
+    uint64_t endPos = announcedBytes;
+    while (!ptsAnchors.isEmpty() && ptsAnchors.head().serial < serial)
+        ptsAnchors.dequeue();
+    if (!ptsAnchors.isEmpty())
+        endPos = ptsAnchors.head().bytePos; // 清空通知晚于新数据的通知到达
+    skipTo(endPos);
+}
 
-    outputDevice->write((char *)audioBuffer, bufferSize);
+void AudioRenderer::skipTo(uint64_t endPos)
+{
+    uint64_t readPos = ringBuffer->totalRead();
+    if (endPos > readPos)
+        ringBuffer->consume(qMin(static_cast<size_t>(endPos - readPos), ringBuffer->availableToRead()));
 }
 
-inline void AudioRenderer::outputAudioFrame(const QByteArray &audioBuffer)
+void AudioRenderer::onStateChanged(int state)
 {
     if (audioOutput == nullptr)
         return;
 
-    outputDevice->write(audioBuffer);
+    if (state == CONTL_TYPE::PAUSE || state == CONTL_TYPE::STOP)
+    {
+        if (audioOutput->state() != QAudio::SuspendedState)
+        {
+            audioOutput->suspend();
+            mediaClock->audio().setPaused(true); // 挂起期间不再取数据, 时钟停在当前值
+        }
+    }
+    else if (state == CONTL_TYPE::PLAY && audioOutput->state() == QAudio::SuspendedState)
+    {
+        audioOutput->resume(); // 时钟在恢复后首次取数据时重新校准
+    }
 }
 
-void AudioRenderer::clean()
+qint64 AudioRenderer::pullAudioData(char *data, qint64 maxSize)
 {
-    if (audioOutput)
+    StageTimer timer(PipelineStats::STAGE_AUDIO_PULL);
+    // 设备中排队的仍是之前交付的数据, 先据此更新时钟
+    updateAudioClock();
+    if (bytesPerMs > 0)
+        PipelineStats::instance()->recordDepth(PipelineStats::DEPTH_AUDIO_RING_MS, std::llround(ringBuffer->availableToRead() / bytesPerMs));
+
+    qint64 size = 0;
+    double pts = NAN;
+    // 暂停/停止时输出静音且不消费数据, 播放结束(END)时继续播完环形缓冲中剩余的数据
+    CONTL_TYPE state = control->getState();
+    if (state == CONTL_TYPE::PLAY || state == CONTL_TYPE::END)
     {
-        audioOutput->stop();
-        audioOutput->deleteLater();
-        audioOutput = nullptr;
-        outputDevice = nullptr;
+        pts = ptsAtReadPos();
+        size = static_cast<qint64>(ringBuffer->read(reinterpret_cast<uint8_t *>(data), static_cast<size_t>(maxSize)));
+        if (size > 0)
+            primed = true;
+        if (size < maxSize && primed && state == CONTL_TYPE::PLAY)
+            ringBuffer->noteUnderrun();
     }
-    lastPtsSeconds = 0;
-    curPtsMs = 0.001;
+
+    // 数据不足时补静音, 设备保持运行
+    memset(data + size, 0, static_cast<size_t>(maxSize - size));
+
+    timer.setBytes(size);
+    if (size > 0)
+        deviceSegments.enqueue({deviceBytes, size, pts});
+    deviceBytes += static_cast<uint64_t>(maxSize);
+    return maxSize;
 }
-void AudioRenderer::recvAudioBuffer(uint8_t *buffer, int bufferSize, double pts_ms)
+
+double AudioRenderer::ptsAtReadPos()
 {
-    if (audioOutput == nullptr)
+    // 取即将被读取的第一个字节的时间戳, 由已消费字节数相对所属数据块起点推算
+    uint64_t readPos = ringBuffer->totalRead();
+    while (ptsAnchors.size() > 1 && ptsAnchors.at(1).bytePos <= readPos)
+        ptsAnchors.dequeue();
+
+    if (ptsAnchors.isEmpty() || ptsAnchors.head().bytePos > readPos)
+        return NAN;
+
+    return ptsAnchors.head().pts + (readPos - ptsAnchors.head().bytePos) / bytesPerMs;
+}
+
+void AudioRenderer::updateAudioClock()
+{
+    if (audioOutput == nullptr || deviceBytes == 0)
+        return;
+
+    // 设备中排队(已交付但未播放)的字节数: 后端已处理的时长与设备缓冲的占用量均是其下界, 取较大者
+    qint64 processedBytes = static_cast<qint64>(audioOutput->processedUSecs() / 1000.0 * bytesPerMs);
+    qint64 queuedBytes = qMax(static_cast<qint64>(deviceBytes) - processedBytes,
+                              static_cast<qint64>(audioOutput->bufferSize() - audioOutput->bytesFree()));
+    uint64_t playedPos = deviceBytes - static_cast<uint64_t>(qBound(static_cast<qint64>(0), queuedBytes, static_cast<qint64>(deviceBytes)));
+
+    while (!deviceSegments.isEmpty() && deviceSegments.head().devicePos + deviceSegments.head().size <= playedPos)
+        deviceSegments.dequeue();
+
+    Clock &audioClock = mediaClock->audio();
+    if (deviceSegments.isEmpty() || deviceSegments.head().devicePos > playedPos)
+    { // 正在播放静音(暂停/数据不足), 时钟停止
+        audioClock.setPaused(true);
+        return;
+    }
+
+    const DeviceSegment &segment = deviceSegments.head();
+    if (std::isnan(segment.pts))
         return;
 
-    while (audioOutput->bytesFree() < bufferSize)
-        QThread::msleep(10);
+    audioClock.set(segment.pts + (playedPos - segment.devicePos) / bytesPerMs);
+    mediaClock->syncExternalToSlave(audioClock);
 
-    curPtsMs = pts_ms + 0.001;
-    int curPtsSeconds = curPtsMs / 1000.0;
+    int curPtsSeconds = audioClock.get() / 1000.0;
     if (curPtsSeconds != lastPtsSeconds)
     {
         lastPtsSeconds = curPtsSeconds;
         emit audioClockChanged(curPtsSeconds);
     }
-    outputAudioFrame(buffer, bufferSize);
-    delete[] buffer;
 }
 
 // void AudioRenderer::recvAudioBuffer(const QByteArray &audioBuffer, double pts_ms)
@@ -1,38 +1,103 @@
 #pragma once
+#include "AudioRingBuffer.h"
+#include "MediaClock.h"
+#include "PlayerControl.h"
 #include <QAudioOutput>
 #include <QIODevice>
+#include <QQueue>
+
+class AudioRenderer;
+
+// 拉模式音频输出设备, 音频后端按需读取, 数据直接取自PCM环形缓冲
+class AudioOutputDevice : public QIODevice
+{
+private:
+    AudioRenderer *renderer;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+public:
+    explicit AudioOutputDevice(AudioRenderer *renderer, QObject *parent = nullptr) : QIODevice(parent), renderer(renderer) {}
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+};
 
 class AudioRenderer : public QObject
 {
+    friend class AudioOutputDevice;
     Q_OBJECT
 signals:
     void audioClockChanged(int pts_s);
     // void audioClockChanged(double pts_ms);
 
 public slots:
-    // 音频输出设备初始化
+    // 音频输出设备初始化, sampleRate为0时仅关闭当前输出
     void onInitAudioOutput(int sampleRate, int channels);
 
-    void recvAudioBuffer(uint8_t *audioBuffer, int bufferSize, double pts);
+    // 环形缓冲中已写入bufferSize字节, 起始时间戳为pts(ms); serial早于最近一次清空的数据直接跳过
+    void recvAudioBuffer(int bufferSize, double pts, int serial);
     // void recvAudioBuffer(const QByteArray &audioBuffer, double pts);
 
-    // 获取音频时钟(必须用Qt::DirectConnection连接)
-    void onGetAudioClock(double &pts) const;
+    // 跳转后丢弃环形缓冲中serial早于serial的数据, 尚未通知的旧数据在通知到达时丢弃
+    void onFlushAudio(int serial);
+
+    // 暂停/停止时挂起设备, 不再回调取数据; 播放时恢复, 设备中已缓存的数据接着播放
+    void onStateChanged(int state);
 
 private:
-    QAudioOutput *audioOutput{nullptr}; // 音频输出
-    QIODevice *outputDevice{nullptr};   // 音频输出设备
+    // 环形缓冲中一段数据的起始位置(累计字节数)、时间戳与所属serial
+    struct PtsAnchor
+    {
+        uint64_t bytePos;
+        double pts;
+        int serial;
+    };
+
+    // 交给设备的一段有效数据在设备数据流中的起始位置(累计字节数)、长度与时间戳, 段之间的空隙为静音
+    struct DeviceSegment
+    {
+        uint64_t devicePos;
+        qint64 size;
+        double pts;
+    };
+
+    AudioRingBuffer *ringBuffer;
+    MediaClock *mediaClock;
+    const PlayerControl *control; // 控制播放状态
+
+    QAudioOutput *audioOutput{nullptr};       // 音频输出
+    AudioOutputDevice *outputDevice{nullptr}; // 音频输出设备
+
+    // 以下成员只在音频线程中访问(后端在创建QAudioOutput的线程中拉取数据)
+    QQueue<PtsAnchor> ptsAnchors;
+    uint64_t announcedBytes{0}; // 已收到通知的写入字节数
+    int flushSerial{0};         // 最近一次清空时的serial, 更早的数据作废
+    bool primed{false};         // 本次打开后是否已取到过数据, 之前的空读不计underrun
+    double bytesPerMs{0.0};
+    QQueue<DeviceSegment> deviceSegments;
+    uint64_t deviceBytes{0}; // 已交给设备的总字节数(含静音)
 
     int lastPtsSeconds = 0;
-    double curPtsMs = 0; // 当前包的时间戳(单位ms)
 
-    // 输出音频帧
-    void outputAudioFrame(uint8_t *audioBuffer, int bufferSize);
-    void outputAudioFrame(const QByteArray &audioBuffer);
+    // 音频后端拉取数据, 不足部分补静音
+    qint64 pullAudioData(char *data, qint64 maxSize);
+    // 环形缓冲读位置(即将交给设备的第一个字节)的时间戳, 未知时返回NAN
+    double ptsAtReadPos();
+    // 跳过环形缓冲中累计位置endPos之前尚未读取的数据
+    void skipTo(uint64_t endPos);
+    // 按设备已播放的字节数更新音频时钟
+    void updateAudioClock();
 
     void clean();
 
 public:
-    explicit AudioRenderer(QObject *parent = nullptr) : QObject(parent) {}
+    explicit AudioRenderer(AudioRingBuffer *ringBuffer, MediaClock *mediaClock, const PlayerControl *control, QObject *parent = nullptr)
+        : QObject(parent), ringBuffer(ringBuffer), mediaClock(mediaClock), control(control) {}
     ~AudioRenderer() override { clean(); }
+
+    int64_t getUnderruns() const { return ringBuffer->getUnderruns(); }
+    int64_t getOverruns() const { return ringBuffer->getOverruns(); }
 };
@@ -0,0 +1,151 @@
+#include "AudioRingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+void AudioRingBuffer::allocate(size_t minCapacity)
+{
+    size_t newCapacity = 4096;
+    while (newCapacity < minCapacity)
+        newCapacity <<= 1;
+
+    if (newCapacity > capacity)
+    {
+        buffer.reset(new uint8_t[newCapacity]);
+        capacity = newCapacity;
+        mask = newCapacity - 1;
+    }
+    reset();
+}
+
+void AudioRingBuffer::reset()
+{
+    writePos.store(0, std::memory_order_relaxed);
+    readPos.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    overruns.store(0, std::memory_order_relaxed);
+
+    QMutexLocker locker(&waitMutex);
+    waitAborted = false;
+}
+
+size_t AudioRingBuffer::availableToWrite() const
+{
+    uint64_t w = writePos.load(std::memory_order_relaxed);
+    uint64_t r = readPos.load(std::memory_order_acquire);
+    return capacity - static_cast<size_t>(w - r);
+}
+
+size_t AudioRingBuffer::write(const uint8_t *data, size_t size)
+{
+    uint64_t w = writePos.load(std::memory_order_relaxed);
+    uint64_t r = readPos.load(std::memory_order_acquire);
+    size_t space = capacity - static_cast<size_t>(w - r);
+    if (size > space)
+    {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        size = space;
+    }
+    if (size == 0)
+        return 0;
+
+    size_t offset = static_cast<size_t>(w) & mask;
+    size_t first = std::min(size, capacity - offset); // 回绕时分两段拷贝
+    memcpy(buffer.get() + offset, data, first);
+    memcpy(buffer.get(), data + first, size - first);
+
+    writePos.store(w + size, std::memory_order_release);
+    return size;
+}
+
+size_t AudioRingBuffer::availableToRead() const
+{
+    uint64_t r = readPos.load(std::memory_order_relaxed);
+    uint64_t w = writePos.load(std::memory_order_acquire);
+    return static_cast<size_t>(w - r);
+}
+
+size_t AudioRingBuffer::read(uint8_t *data, size_t size)
+{
+    uint64_t r = readPos.load(std::memory_order_relaxed);
+    uint64_t w = writePos.load(std::memory_order_acquire);
+    size = std::min(size, static_cast<size_t>(w - r));
+    if (size == 0)
+        return 0;
+
+    size_t offset = static_cast<size_t>(r) & mask;
+    size_t first = std::min(size, capacity - offset);
+    memcpy(data, buffer.get() + offset, first);
+    memcpy(data + first, buffer.get(), size - first);
+
+    readPos.store(r + size, std::memory_order_release);
+    wakeWriter();
+    return size;
+}
+
+const uint8_t *AudioRingBuffer::peek(size_t *contiguous) const
+{
+    uint64_t r = readPos.load(std::memory_order_relaxed);
+    uint64_t w = writePos.load(std::memory_order_acquire);
+    size_t offset = static_cast<size_t>(r) & mask;
+    *contiguous = std::min(static_cast<size_t>(w - r), capacity - offset);
+    return buffer.get() + offset;
+}
+
+void AudioRingBuffer::consume(size_t size)
+{
+    uint64_t r = readPos.load(std::memory_order_relaxed);
+    readPos.store(r + size, std::memory_order_release);
+    wakeWriter();
+}
+
+void AudioRingBuffer::wakeWriter()
+{
+    // 与waitForWritable中先置writerWaiting再检查读位置配对: 要么生产者看到新的读位置, 要么这里看到等待标志
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!writerWaiting.load(std::memory_order_relaxed))
+        return;
+
+    QMutexLocker locker(&waitMutex);
+    writable.wakeOne();
+}
+
+bool AudioRingBuffer::waitForWritable(size_t maxFill)
+{
+    QMutexLocker locker(&waitMutex);
+    uint64_t interrupts = interruptCount;
+    bool ready = false;
+    while (!waitAborted && interrupts == interruptCount)
+    {
+        writerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t fill = availableToRead();
+        if (fill < maxFill && fill < capacity)
+        {
+            ready = true;
+            break;
+        }
+        writable.wait(&waitMutex);
+    }
+    writerWaiting.store(false, std::memory_order_relaxed);
+    return ready;
+}
+
+void AudioRingBuffer::interruptWait()
+{
+    QMutexLocker locker(&waitMutex);
+    interruptCount++;
+    writable.wakeAll();
+}
+
+void AudioRingBuffer::abortWait()
+{
+    QMutexLocker locker(&waitMutex);
+    waitAborted = true;
+    writable.wakeAll();
+}
+
+bool AudioRingBuffer::isWaitAborted()
+{
+    QMutexLocker locker(&waitMutex);
+    return waitAborted;
+}
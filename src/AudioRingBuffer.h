@@ -0,0 +1,74 @@
+#pragma once
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// 单生产者单消费者PCM环形缓冲, 音频解码线程写入, 音频输出读取
+// 写位置只由生产者修改, 读位置只由消费者修改, 读写均无锁; 位置单调递增, 按容量(2的幂)取模得到下标
+class AudioRingBuffer
+{
+private:
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t capacity{0};
+    size_t mask{0};
+
+    std::atomic<uint64_t> writePos{0};
+    std::atomic<uint64_t> readPos{0};
+
+    std::atomic<int64_t> underruns{0}; // 播放中读取时数据不足(出现静音)的次数
+    std::atomic<int64_t> overruns{0};  // 写入时空间不足(未能完整写入)的次数
+
+    // 生产者等待可写时挂起在writable上, 消费者读出数据后仅在有等待者时加锁唤醒
+    QMutex waitMutex;
+    QWaitCondition writable;
+    std::atomic<bool> writerWaiting{false};
+    bool waitAborted{false};    // 由waitMutex保护
+    uint64_t interruptCount{0}; // 由waitMutex保护
+
+    void wakeWriter();
+
+public:
+    AudioRingBuffer() = default;
+    AudioRingBuffer(const AudioRingBuffer &) = delete;
+    AudioRingBuffer &operator=(const AudioRingBuffer &) = delete;
+
+    // 分配不小于minCapacity字节的缓冲并清空, 容量足够时不重新分配; 调用期间生产者与消费者均不得访问
+    void allocate(size_t minCapacity);
+    // 清空并重置计数, 解除abortWait, 要求同allocate
+    void reset();
+
+    size_t getCapacity() const { return capacity; }
+
+    // 生产者: 可写字节数
+    size_t availableToWrite() const;
+    // 生产者: 写入最多size字节, 返回实际写入字节数; 空间不足时计一次overrun
+    size_t write(const uint8_t *data, size_t size);
+
+    // 消费者: 可读字节数
+    size_t availableToRead() const;
+    // 消费者: 读出最多size字节, 返回实际读出字节数
+    size_t read(uint8_t *data, size_t size);
+    // 消费者: 取得从读位置开始可连续读取的区域, 处理完后调用consume
+    const uint8_t *peek(size_t *contiguous) const;
+    void consume(size_t size);
+
+    // 生产者: 挂起直到缓存数据少于maxFill字节且有空间可写, 返回true
+    // 被interruptWait唤醒或已abortWait时返回false, 调用方应重新检查播放状态
+    bool waitForWritable(size_t maxFill);
+    // 唤醒挂起的生产者, 播放状态变化/跳转时调用
+    void interruptWait();
+    // 中止等待, 之后waitForWritable立即返回false, 直到reset
+    void abortWait();
+    bool isWaitAborted();
+
+    // 累计读出字节数, 可据此按已消费数据推算播放位置
+    uint64_t totalRead() const { return readPos.load(std::memory_order_acquire); }
+
+    // 消费者在播放中未能取到足够数据时调用
+    void noteUnderrun() { underruns.fetch_add(1, std::memory_order_relaxed); }
+    int64_t getUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+    int64_t getOverruns() const { return overruns.load(std::memory_order_relaxed); }
+};
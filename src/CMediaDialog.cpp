@@ -1,10 +1,12 @@
 #include "CMediaDialog.h"
+#include "TraceWriter.h"
 #include <QApplication>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPaintEvent>
+#include <QPixmap>
 #include <QPushButton>
 #include <QScrollArea>
 #include <QStackedLayout>
@@ -104,32 +106,45 @@ ControlWidget::ControlWidget(QWidget *parent) : QWidget(parent)
         btn->setStyleSheet("background-color: white;");
         sliderWidget->layout()->addWidget(btn);
         connect(btn, &QPushButton::clicked, [&]() { //
-            this->m_type = CONTL_TYPE::END;
+            this->control.setState(CONTL_TYPE::END);
         });
     }
 
-    decode_th = new Decoder(&m_type);
+    decode_th = new Decoder(&control);
     decodeThread = new QThread();
+    decodeThread->setObjectName("decoder");
     decode_th->moveToThread(decodeThread);
     decodeThread->start();
-    connect(this, &ControlWidget::startPlay, decode_th, &Decoder::decodePacket);
+    connect(this, &ControlWidget::commandPosted, decode_th, &Decoder::processCommands);
     connect(decode_th, &Decoder::playOver, this, &ControlWidget::onPlayOver);
+    connect(decode_th, &Decoder::openProgress, this, &ControlWidget::onOpenProgress);
+    connect(decode_th, &Decoder::mediaReady, this, &ControlWidget::onMediaReady);
+    connect(decode_th, &Decoder::openFailed, this, &ControlWidget::onOpenFailed);
 
-    audio_th = new AudioRenderer();
+    audio_th = new AudioRenderer(decode_th->getAudioRingBuffer(), decode_th->getMediaClock(), &control);
     audioThread = new QThread();
+    audioThread->setObjectName("audio_output");
     audio_th->moveToThread(audioThread);
     audioThread->start();
-    connect(decode_th, &Decoder::initAudioOutput, audio_th, &AudioRenderer::onInitAudioOutput, Qt::DirectConnection);
-    connect(decode_th, &Decoder::getCurPts, audio_th, &AudioRenderer::onGetAudioClock, Qt::DirectConnection); // 必须直连
+    connect(decode_th, &Decoder::initAudioOutput, audio_th, &AudioRenderer::onInitAudioOutput, Qt::BlockingQueuedConnection); // 在音频线程中创建输出并分配环形缓冲, 排在旧数据之后执行
+    connect(decode_th, &Decoder::flushAudio, audio_th, &AudioRenderer::onFlushAudio);
+    connect(decode_th, &Decoder::stateChanged, audio_th, &AudioRenderer::onStateChanged);
     connect(decode_th->getAudioDecoder(), &AudioDecoder::sendAudioBuffer, audio_th, &AudioRenderer::recvAudioBuffer);
-    connect(audio_th, &AudioRenderer::audioClockChanged, this, &ControlWidget::onAudioClockChanged);
+    connect(audio_th, &AudioRenderer::audioClockChanged, this, &ControlWidget::onClockChanged);
 
-    video_th = new VideoWaiter();
+    video_th = new VideoWaiter(decode_th->getVideoFrameQueue(), decode_th->getMediaClock(), &control);
     videoThread = new QThread();
+    videoThread->setObjectName("video_present");
     video_th->moveToThread(videoThread);
     videoThread->start();
-    connect(decode_th->getVideoDecoder(), &VideoDecoder::sendVideoFrame, video_th, &VideoWaiter::recvVideoFrame);
-    connect(video_th, &VideoWaiter::getAudioClock, audio_th, &AudioRenderer::onGetAudioClock, Qt::DirectConnection); // 必须直连
+    connect(decode_th, &Decoder::startPlay, video_th, &VideoWaiter::presentLoop);
+    connect(decode_th, &Decoder::stepVideo, video_th, &VideoWaiter::onStepFrame);
+    connect(decode_th->getVideoDecoder(), &VideoDecoder::stepDecoded, video_th, &VideoWaiter::onStepDecoded);
+    connect(decode_th->getVideoDecoder(), &VideoDecoder::scrubFrameReady, video_th, &VideoWaiter::onScrubFrame);
+    connect(decode_th->getVideoDecoder(), &VideoDecoder::stepFrameReady, video_th, &VideoWaiter::onCachedStepFrame);
+    connect(decode_th, &Decoder::reverseVideo, video_th, &VideoWaiter::reverseLoop);
+    connect(video_th, &VideoWaiter::videoClockChanged, this, &ControlWidget::onClockChanged);
+    connect(decode_th, &Decoder::initClock, video_th, &VideoWaiter::onInitClock);
 
     // this->label->menu = new QMenu(this);
     // auto actSS = new QAction("开始保存", this->label->menu);
@@ -144,7 +159,26 @@ ControlWidget::ControlWidget(QWidget *parent) : QWidget(parent)
     // });
 
     connect(slider, &CSlider::sliderClicked, this, &ControlWidget::startSeek);
-    connect(slider, &CSlider::sliderMoved, decode_th, &Decoder::setCurFrame);
+    connect(slider, &CSlider::sliderDragged, this, &ControlWidget::onScrubRequest);
+    connect(slider, &CSlider::sliderHovered, this, &ControlWidget::onSliderHovered);
+    connect(slider, &CSlider::hoverLeft, this, &ControlWidget::onSliderHoverLeft);
+
+    // 缩略图在独立的最低优先级线程中生成, 使用自己的解复用器与解码器, 不影响播放
+    thumbnailLabel = new QLabel(this);
+    thumbnailLabel->setStyleSheet("color: white; background-color: black; border: 1px solid #c4c4c4;");
+    thumbnailLabel->setAlignment(Qt::AlignCenter);
+    thumbnailLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+    thumbnailLabel->hide();
+
+    thumbnail_th = new ThumbnailGenerator(&thumbnailCache);
+    thumbnailThread = new QThread();
+    thumbnailThread->setObjectName("thumbnail");
+    thumbnail_th->moveToThread(thumbnailThread);
+    thumbnailThread->start(QThread::LowestPriority);
+    connect(this, &ControlWidget::thumbnailsRequested, thumbnail_th, &ThumbnailGenerator::generate);
+    connect(this, &ControlWidget::thumbnailReloadRequested, thumbnail_th, &ThumbnailGenerator::reload);
+    connect(thumbnail_th, &ThumbnailGenerator::thumbnailReady, this, &ControlWidget::onThumbnailReady);
+    connect(slider, &CSlider::sliderMoved, this, &ControlWidget::onSeekRequest);
     connect(slider, &CSlider::sliderReleased, this, &ControlWidget::endSeek);
 
     // connect(video_th, &VideoThread::finishPlay, this, &CMediaDialog::terminatePlay);
@@ -152,11 +186,14 @@ ControlWidget::ControlWidget(QWidget *parent) : QWidget(parent)
 
 ControlWidget::~ControlWidget()
 {
+    decode_th->cancelOpen(); // 中断进行中的打开, 解码线程才能及时退出
+    thumbnail_th->cancel();
     terminatePlay();
 
     decode_th->deleteLater();
     audio_th->deleteLater();
     video_th->deleteLater();
+    thumbnail_th->deleteLater();
 
     decodeThread->quit();
     decodeThread->wait();
@@ -170,31 +207,71 @@ ControlWidget::~ControlWidget()
     videoThread->wait();
     videoThread->deleteLater();
 
+    thumbnailThread->quit();
+    thumbnailThread->wait();
+    thumbnailThread->deleteLater();
+
     qDebug() << "ControlWidget::~ControlWidget()";
 }
 
 void ControlWidget::showVideo(const QString &path)
 {
-    if (m_type != CONTL_TYPE::NONE)
+    if (control.getState() != CONTL_TYPE::NONE)
     {
         terminatePlay();
         slider->setValue(0);
         timeLabel->setText("00:00");
         totalTimeLabel->setText("00:00");
-        qApp->processEvents(); // 强制更新UI
-        QThread::msleep(100);
+        // 无需等待: 解码线程打开前先中止各队列并等待各线程循环退出再释放资源
     }
-    decode_th->setVideoPath(path);
+    // 旧媒体的缩略图不再生成
+    thumbnailSerial = thumbnail_th->nextSerial();
+    thumbnailCache.reset(QString(), 0);
+    onSliderHoverLeft();
+
+    // 在解码线程中打开, 界面不阻塞; 打开完成后在onMediaReady中开始播放
+    openSerial = decode_th->openAsync(path);
+}
 
-    int64_t duration_ms = decode_th->getDuration();
-    int duration_s = static_cast<int>(duration_ms / 1000);
+void ControlWidget::onOpenProgress(int serial, int stage)
+{
+    if (serial != openSerial)
+        return;
+    timeLabel->setText(Decoder::openStageName(stage) + "...");
+}
+
+void ControlWidget::onMediaReady(int serial, const Decoder::MediaInfo &info)
+{
+    if (serial != openSerial)
+        return;
+
+    qDebug() << "media ready:" << info.filePath << info.formatName << "audio:" << info.audioCodec << info.sampleRate << info.channels
+             << "video:" << info.videoCodec << info.width << "x" << info.height << info.frameRate << "fps" << info.hwDevice;
+    timeLabel->setText("00:00");
+    int duration_s = static_cast<int>(info.durationMs / 1000);
     slider->setRange(0, duration_s);
     if (duration_s > 3600)
         totalTimeLabel->setText(QString::asprintf("%02d:%02d:%02d", duration_s / 3600, duration_s / 60 % 60, duration_s % 60));
     else
         totalTimeLabel->setText(QString::asprintf("%02d:%02d", duration_s / 60 % 60, duration_s % 60));
-    m_type = CONTL_TYPE::PLAY;
-    emit ControlWidget::startPlay();
+    postCommand(CMD_PLAY);
+
+    // 探测缓存已写入, 缩略图线程打开同一文件时无需再次探测
+    if (!info.videoCodec.isEmpty() && info.durationMs > 0)
+    {
+        thumbnailCache.reset(info.filePath, info.durationMs);
+        emit thumbnailsRequested(info.filePath, info.durationMs, thumbnailSerial);
+    }
+}
+
+void ControlWidget::onOpenFailed(int serial, int error)
+{
+    if (serial != openSerial)
+        return;
+
+    qDebug() << "open failed, error:" << error;
+    timeLabel->setText("00:00");
+    totalTimeLabel->setText("00:00");
 }
 
 void ControlWidget::resumeUI()
@@ -203,68 +280,132 @@ void ControlWidget::resumeUI()
     timeLabel->setText("00:00");
 }
 
-void ControlWidget::onAudioClockChanged(int pts_seconds)
+static QString formatTime(int seconds)
 {
-    slider->setValue(pts_seconds);
-    QString pts_str;
-    if (pts_seconds > 3600)
-        pts_str = QString::asprintf("%02d:%02d:%02d", pts_seconds / 3600, pts_seconds / 60 % 60, pts_seconds % 60);
-    else
-        pts_str = QString::asprintf("%02d:%02d", pts_seconds / 60 % 60, pts_seconds % 60);
+    if (seconds > 3600)
+        return QString::asprintf("%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return QString::asprintf("%02d:%02d", seconds / 60 % 60, seconds % 60);
+}
 
-    timeLabel->setText(pts_str);
+void ControlWidget::onClockChanged(int pts_seconds)
+{
+    slider->setValue(pts_seconds);
+    timeLabel->setText(formatTime(pts_seconds));
 }
 
 void ControlWidget::changePlayState()
 {
-    switch (m_type)
+    switch (control.getState())
     {
     case CONTL_TYPE::END:
         resumeUI();
-        m_type = CONTL_TYPE::RESUME;
+        postCommand(CMD_STOP); // 再次点击时从头播放
         break;
 
     case CONTL_TYPE::PLAY:
-        m_type = CONTL_TYPE::PAUSE;
+        postCommand(CMD_PAUSE);
         break;
 
     case CONTL_TYPE::PAUSE:
-        m_type = CONTL_TYPE::PLAY;
-        break;
-
     case CONTL_TYPE::STOP:
-    case CONTL_TYPE::RESUME:
-        decode_th->resume();
-        m_type = CONTL_TYPE::PLAY;
+    case CONTL_TYPE::RESUME: // 从停止状态开始播放时由解码线程回到开头
+        postCommand(CMD_PLAY);
         break;
 
     default:
         break;
     }
-    emit ControlWidget::startPlay();
-    debugPlayerCommand((CONTL_TYPE)m_type);
+}
+
+void ControlWidget::postCommand(PLAYER_COMMAND type, int64_t arg)
+{
+    if (control.post(type, arg) == 0)
+    {
+        qDebug() << "player command queue full, drop:" << playerCommandName(type);
+        return;
+    }
+    emit commandPosted();
 }
 
 void ControlWidget::startSeek()
 {
-    isPlay = (m_type == CONTL_TYPE::PLAY);
-    m_type = CONTL_TYPE::PAUSE;
+    isPlay = (control.getState() == CONTL_TYPE::PLAY);
+    postCommand(CMD_PAUSE);
 }
 
 void ControlWidget::endSeek()
 {
-    m_type = (isPlay ? CONTL_TYPE::PLAY : CONTL_TYPE::PAUSE);
-    emit ControlWidget::startPlay();
+    // 命令按投递顺序执行, 暂停与跳转已在此之前生效; 保持暂停时步进一帧, 以精确跳转的目标帧替换预览的关键帧
+    postCommand(isPlay ? CMD_PLAY : CMD_STEP);
+}
+
+void ControlWidget::onSeekRequest(int value)
+{
+    postCommand(CMD_SEEK, static_cast<int64_t>(value) * 1000);
+}
+
+void ControlWidget::onScrubRequest(int value)
+{
+    // 不等待上一次预览完成, 解码线程只执行最新的预览命令
+    timeLabel->setText(formatTime(value));
+    postCommand(CMD_SCRUB, static_cast<int64_t>(value) * 1000);
+}
+
+void ControlWidget::onSliderHovered(int value, int x)
+{
+    hoverValue = value;
+    hoverX = x;
+    updateThumbnail();
+}
+
+void ControlWidget::onSliderHoverLeft()
+{
+    hoverValue = -1;
+    hoverIndex = -1;
+    thumbnailLabel->hide();
+}
+
+void ControlWidget::onThumbnailReady(int index)
+{
+    if (hoverValue >= 0 && index == hoverIndex)
+        updateThumbnail();
+}
+
+void ControlWidget::updateThumbnail()
+{
+    if (hoverValue < 0 || thumbnailCache.getCount() == 0)
+        return;
+
+    // 只查内存缓存; 未生成时显示时间, 已被淘汰时请求缩略图线程从sprite重新载入
+    QImage image;
+    if (thumbnailCache.find(static_cast<int64_t>(hoverValue) * 1000, &image, &hoverIndex))
+        thumbnailLabel->setPixmap(QPixmap::fromImage(image));
+    else
+    {
+        thumbnailLabel->setText(formatTime(hoverValue));
+        if (hoverIndex != reloadIndex)
+        {
+            reloadIndex = hoverIndex;
+            emit thumbnailReloadRequested(thumbnailCache.getMediaPath(), hoverIndex, thumbnailSerial);
+        }
+    }
+
+    thumbnailLabel->adjustSize();
+    QPoint pos = slider->mapTo(this, QPoint(hoverX, 0));
+    int x = qBound(0, pos.x() - thumbnailLabel->width() / 2, qMax(0, width() - thumbnailLabel->width()));
+    thumbnailLabel->move(x, pos.y() - thumbnailLabel->height());
+    thumbnailLabel->show();
+    thumbnailLabel->raise();
 }
 
 void ControlWidget::terminatePlay()
 {
-    m_type = CONTL_TYPE::STOP;
+    control.stop(); // 直接停止, 不经过命令队列, 之前投递而未执行的命令作废
 }
 
 void ControlWidget::onPlayOver()
 {
-    m_type = CONTL_TYPE::END;
+    control.setState(CONTL_TYPE::END);
     slider->setValue(slider->maximum());
     timeLabel->setText(totalTimeLabel->text());
 }
@@ -295,6 +436,18 @@ void ControlWidget::keyPressEvent(QKeyEvent *event)
     case Qt::Key_Right:
         slider->moveToValue(slider->value() + 10);
         break;
+    case Qt::Key_Period: // 暂停时逐帧前进
+        postCommand(CMD_STEP);
+        break;
+    case Qt::Key_Comma: // 暂停时逐帧后退
+        postCommand(CMD_STEP_BACK);
+        break;
+    case Qt::Key_R: // 开始/结束倒放
+        postCommand(CMD_REVERSE);
+        break;
+    case Qt::Key_I: // 输出流水线各阶段耗时与队列深度, 卡顿时定位瓶颈
+        qDebug().noquote() << PipelineStats::instance()->summary();
+        break;
 
     default:
         QWidget::keyPressEvent(event);
@@ -332,11 +485,14 @@ void CSlider::mousePressEvent(QMouseEvent *event)
     if (event->button() == Qt::LeftButton)
     {
         this->isPress = true;
+        emit CSlider::hoverLeft(); // 拖动时由播放画面预览
         // 获取鼠标的位置，这里并不能直接从ev中取值（因为如果是拖动的话，鼠标开始点击的位置没有意义了）
         double pos = event->pos().x() / (double)width();
         setValue(pos * (maximum() - minimum()) + minimum());
         // qDebug() << "setValue: " << this->value();
         emit CSlider::sliderClicked();
+        lastLocation = this->value();
+        emit CSlider::sliderDragged(lastLocation);
     }
 }
 
@@ -349,11 +505,17 @@ void CSlider::mouseMoveEvent(QMouseEvent *event)
         int value = pos * (maximum() - minimum()) + minimum();
         setValue(value);
 
-        // if (qAbs(value - this->lastLocation) > (one_percent * 5))
-        // {
-        //     lastLocation = value;
-        //     emit CSlider::sliderMoved(value);
-        // }
+        // 进度条以秒为单位, 同一秒内的移动不重复预览
+        if (this->value() != lastLocation)
+        {
+            lastLocation = this->value();
+            emit CSlider::sliderDragged(lastLocation);
+        }
+    }
+    else if (event->buttons() == Qt::NoButton && width() > 0)
+    {
+        double pos = qBound(0.0, event->pos().x() / (double)width(), 1.0);
+        emit CSlider::sliderHovered(pos * (maximum() - minimum()) + minimum(), event->pos().x());
     }
 }
 
@@ -370,13 +532,17 @@ void CSlider::mouseReleaseEvent(QMouseEvent *event)
     }
 }
 
+void CSlider::leaveEvent(QEvent *event)
+{
+    emit CSlider::hoverLeft();
+    QSlider::leaveEvent(event);
+}
+
 void CSlider::moveToValue(int value)
 {
+    // 暂停, 跳转, 恢复依次进入命令队列, 按顺序执行, 无需等待解码线程暂停
     emit sliderClicked();
     setValue(value);
-
-    QThread::msleep(10); // 保证decoder线程暂停
-
     emit sliderMoved(value);
     emit sliderReleased();
 }
@@ -428,10 +594,11 @@ void FrameWidget::onInitVideoOutput(int format)
     }
 }
 
-void FrameWidget::receviceFrame(uint8_t *pixelData, int pixelWidth, int pixelHeight)
+void FrameWidget::receviceFrame(AVFrame *frame)
 {
+    TraceWriter::asyncEnd("queued_signal", frame);
     if (glWidget)
-        glWidget->setPixelData(pixelData, pixelWidth, pixelHeight);
-    else if (pixelData)
-        delete pixelData;
+        glWidget->setFrame(frame);
+    else if (frame)
+        av_frame_free(&frame);
 }
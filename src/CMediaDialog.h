@@ -2,6 +2,8 @@
 #include "AudioRenderer.h"
 #include "Decode.h"
 #include "OpenGLWidget.h"
+#include "PlayerControl.h"
+#include "ThumbnailCache.h"
 #include "VideoWaiter.h"
 #include "playerCommand.h"
 #include <QApplication>
@@ -18,7 +20,7 @@ class FrameWidget : public QWidget
     Q_OBJECT
 public slots:
     void onInitVideoOutput(int format);
-    void receviceFrame(uint8_t *pixelData, int pixelWidth, int pixelHeight);
+    void receviceFrame(AVFrame *frame);
 
 private:
     int curGLWidgetFormat{-1};
@@ -38,21 +40,29 @@ class CSlider : public QSlider
     Q_OBJECT
 private:
     bool isPress{false};
-    int lastLocation{0}; // 减少移动时发出切换帧信号次数
+    int lastLocation{-1}; // 上次发出预览信号的位置, 位置不变时不重复发出
     int one_percent{0};
 
 signals:
     void sliderClicked();
+    // 按下与拖动中位置变化, 用于预览
+    void sliderDragged(int value);
+    // 松开时的最终位置
     void sliderMoved(int value);
     void sliderReleased();
+    // 未按下时鼠标悬停位置对应的值, x为鼠标在进度条内的横坐标
+    void sliderHovered(int value, int x);
+    // 鼠标离开或按下, 结束悬停
+    void hoverLeft();
 
 protected:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
+    void leaveEvent(QEvent *event);
 
 public:
-    CSlider(Qt::Orientation orientation, QWidget *parent = nullptr) : QSlider(orientation, parent) {}
+    CSlider(Qt::Orientation orientation, QWidget *parent = nullptr) : QSlider(orientation, parent) { setMouseTracking(true); }
 
     void moveToValue(int value);
     void setRange(int min, int max);
@@ -64,15 +74,19 @@ class ControlWidget : public QWidget
     Q_OBJECT
 
 signals:
-    void startPlay();
+    // 已向控制命令队列投递命令, 通知解码线程执行
+    void commandPosted();
     void leftClicked();
     void rightClicked();
     // 全屏请求
     void fullScreenRequest();
+    // 内部使用: 请求缩略图线程载入/生成缩略图, 重新载入被淘汰的一张
+    void thumbnailsRequested(const QString &filePath, qint64 durationMs, int serial);
+    void thumbnailReloadRequested(const QString &filePath, int index, int serial);
 
 private slots:
-    // 响应音频进度条
-    void onAudioClockChanged(int pts_seconds);
+    // 响应主时钟(音频时钟或无音频时的视频时钟)更新进度条
+    void onClockChanged(int pts_seconds);
 
     // 响应拖动进度条, 当鼠标压下时暂停, 并保存播放状态
     void startSeek();
@@ -80,11 +94,28 @@ private slots:
     // 响应拖动进度条, 当鼠标松开时恢复播放状态
     void endSeek();
 
+    // 响应进度条位置变化, 跳转到value(s)
+    void onSeekRequest(int value);
+
+    // 响应拖动中的位置变化, 预览value(s)附近的关键帧
+    void onScrubRequest(int value);
+
+    // 悬停在进度条上时在其上方显示value(s)处的缩略图, 只查内存缓存, 不经过播放解码器
+    void onSliderHovered(int value, int x);
+    void onSliderHoverLeft();
+    // 悬停位置的缩略图生成/载入后刷新
+    void onThumbnailReady(int index);
+
     // 强制关闭
     void terminatePlay();
 
     void onPlayOver(); // 播放结束
 
+    // 异步打开媒体的进度与结果, 只处理最近一次打开请求
+    void onOpenProgress(int serial, int stage);
+    void onMediaReady(int serial, const Decoder::MediaInfo &info);
+    void onOpenFailed(int serial, int error);
+
 private:
     QWidget *sliderWidget{nullptr};
     CSlider *slider{nullptr};
@@ -92,6 +123,7 @@ private:
     QLabel *totalTimeLabel{nullptr};
     QPushButton *btn{nullptr}; // 测试用
     QMenu *menu{nullptr};
+    QLabel *thumbnailLabel{nullptr}; // 悬停预览
 
     Decoder *decode_th{nullptr};
     VideoWaiter *video_th{nullptr};
@@ -100,9 +132,23 @@ private:
     QThread *videoThread{nullptr};
     QThread *audioThread{nullptr};
 
-    int m_type{NONE};
+    // 缩略图: 生成线程写入缓存, 界面线程悬停时查找
+    ThumbnailCache thumbnailCache;
+    ThumbnailGenerator *thumbnail_th{nullptr};
+    QThread *thumbnailThread{nullptr};
+    int thumbnailSerial{0};
+    int hoverValue{-1};  // 悬停位置(s), 未悬停时为-1
+    int hoverX{0};       // 悬停位置在进度条内的横坐标
+    int hoverIndex{-1};  // 悬停位置对应的缩略图序号
+    int reloadIndex{-1}; // 最近请求重新载入的序号, 避免悬停不动时重复请求
+
+    // 按悬停位置更新缩略图及其位置
+    void updateThumbnail();
+
+    PlayerControl control; // 播放状态与控制命令队列
 
     bool isPlay = false; // 保存拖动进度条前视频播放状态
+    int openSerial{0};   // 最近一次打开请求的序号
 
 protected:
     virtual void mousePressEvent(QMouseEvent *event) override;
@@ -120,6 +166,9 @@ public:
     void showVideo(const QString &path);
     void resumeUI();
     void changePlayState();
+    // 投递控制命令, 由解码线程按投递顺序执行
+    void postCommand(PLAYER_COMMAND type, int64_t arg = 0);
+    const PlayerControl &getControl() const { return control; }
 };
 
 class CMediaDialog : public QWidget
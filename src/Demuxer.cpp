@@ -0,0 +1,192 @@
+#include "Demuxer.h"
+#include "MediaClock.h"
+#include "PipelineStats.h"
+#include "TraceWriter.h"
+#include <QDebug>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#define MAX_QUEUE_BYTES (32 * 1024 * 1024) // 音视频包队列总字节数硬上限, 交错极差的文件也不会超出
+#define BYTE_SEEK_PROBE_PACKETS 64          // 按字节定位后最多读取的包数, 仍未读到目标流的包时视为定位失败
+
+Demuxer::Demuxer(PacketQueue *audioQueue, PacketQueue *videoQueue, QObject *parent)
+    : QObject(parent),
+      audioPacketQueue(audioQueue),
+      videoPacketQueue(videoQueue)
+{
+    audioPacketQueue->setConsumedNotifier(&waitMutex, &continueRead);
+    videoPacketQueue->setConsumedNotifier(&waitMutex, &continueRead);
+    connect(this, &Demuxer::startDemux, this, &Demuxer::demuxPacket, Qt::QueuedConnection);
+}
+
+void Demuxer::start(AVFormatContext *_formatContext, int _audioStreamIndex, int _videoStreamIndex)
+{
+    formatContext = _formatContext;
+    audioStreamIndex = _audioStreamIndex;
+    videoStreamIndex = _videoStreamIndex;
+
+    {
+        QMutexLocker locker(&waitMutex);
+        seekRequest = false;
+        abortRequest = false;
+    }
+    audioPacketQueue->start();
+    videoPacketQueue->start();
+    emit startDemux();
+}
+
+void Demuxer::stop()
+{
+    {
+        QMutexLocker locker(&waitMutex);
+        abortRequest = true;
+        continueRead.wakeAll();
+    }
+    audioPacketQueue->abort();
+    videoPacketQueue->abort();
+
+    QMutexLocker loopLocker(&loopMutex); // 等待解复用循环退出
+}
+
+void Demuxer::seek(int streamIndex, int64_t timestamp, int64_t bytePos, int64_t keyframePts)
+{
+    QMutexLocker locker(&waitMutex);
+    seekStreamIndex = streamIndex;
+    seekTimestamp = timestamp;
+    seekBytePos = bytePos;
+    seekKeyframePts = keyframePts;
+    seekRequest = true;
+
+    audioPacketQueue->flush();
+    videoPacketQueue->flush();
+    continueRead.wakeAll();
+}
+
+bool Demuxer::seekToKeyframe(int streamIndex, int64_t bytePos, int64_t keyframePts, QVector<AVPacket *> *packets)
+{
+    if (av_seek_frame(formatContext, -1, bytePos, AVSEEK_FLAG_BYTE) < 0)
+        return false;
+
+    // 解复用器可能从该位置重新同步到之后的包, 目标流的第一个包晚于关键帧说明已越过它
+    for (int i = 0; i < BYTE_SEEK_PROBE_PACKETS; i++)
+    {
+        AVPacket *packet = av_packet_alloc();
+        if (av_read_frame(formatContext, packet) < 0)
+        {
+            av_packet_free(&packet);
+            break;
+        }
+        packets->append(packet);
+        if (packet->stream_index != streamIndex)
+            continue;
+
+        int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (pts != AV_NOPTS_VALUE && pts <= keyframePts)
+            return true;
+        break;
+    }
+
+    for (AVPacket *packet : *packets)
+        av_packet_free(&packet);
+    packets->clear();
+    return false;
+}
+
+void Demuxer::dispatch(AVPacket *packet)
+{
+    if (packet->stream_index == audioStreamIndex)
+        audioPacketQueue->push(packet);
+    else if (packet->stream_index == videoStreamIndex)
+        videoPacketQueue->push(packet);
+    else
+        av_packet_free(&packet);
+}
+
+bool Demuxer::queuesAreFull() const
+{
+    if (audioPacketQueue->byteSize() + videoPacketQueue->byteSize() >= MAX_QUEUE_BYTES)
+        return true;
+
+    // 只要还有一个流未满就继续读取, 避免交错差的文件饿死另一个流
+    bool audioFull = audioStreamIndex < 0 || audioPacketQueue->isFull();
+    bool videoFull = videoStreamIndex < 0 || videoPacketQueue->isFull();
+    return audioFull && videoFull;
+}
+
+void Demuxer::demuxPacket()
+{
+    QMutexLocker loopLocker(&loopMutex);
+    if (formatContext == nullptr)
+        return;
+
+    bool eof = false;
+    while (!abortRequest)
+    {
+        bool doSeek = false;
+        int streamIndex = -1;
+        int64_t timestamp = 0;
+        int64_t bytePos = -1;
+        int64_t keyframePts = 0;
+        {
+            QMutexLocker locker(&waitMutex);
+            std::swap(doSeek, seekRequest);
+            streamIndex = seekStreamIndex;
+            timestamp = seekTimestamp;
+            bytePos = seekBytePos;
+            keyframePts = seekKeyframePts;
+        }
+
+        if (doSeek)
+        {
+            double seekStart = Clock::nowMs();
+            QVector<AVPacket *> packets; // 确认字节定位落点时读到的包
+            if (bytePos >= 0 && seekToKeyframe(streamIndex, bytePos, keyframePts, &packets))
+                ; // 直接定位到关键帧所在位置
+            else if (av_seek_frame(formatContext, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+                qDebug() << "av_seek_frame fail, timestamp:" << timestamp;
+            TraceWriter::span("seek", seekStart);
+
+            // 丢弃跳转请求与实际跳转之间读入的旧包
+            audioPacketQueue->flush();
+            videoPacketQueue->flush();
+            for (AVPacket *packet : packets)
+                dispatch(packet);
+            eof = false;
+        }
+
+        if (eof || queuesAreFull())
+        {
+            QMutexLocker locker(&waitMutex);
+            // 持锁重新检查, 出队通知需先取得waitMutex, 检查之后的出队一定能唤醒本线程
+            if (abortRequest || seekRequest || (!eof && !queuesAreFull()))
+                continue;
+
+            // 读到末尾后只有跳转或停止能唤醒, 队列满时出队也会唤醒; 暂停期间不出队, 一直挂起
+            double waitStart = Clock::nowMs();
+            continueRead.wait(&waitMutex);
+            if (!eof)
+                PipelineStats::instance()->record(PipelineStats::STAGE_DEMUX_WAIT, Clock::nowMs() - waitStart);
+            continue;
+        }
+
+        AVPacket *packet = av_packet_alloc();
+        double readStart = Clock::nowMs();
+        int ret = av_read_frame(formatContext, packet);
+        TraceWriter::span("read", readStart);
+        if (ret < 0)
+        {
+            av_packet_free(&packet);
+            if (audioStreamIndex >= 0)
+                audioPacketQueue->pushEof(audioStreamIndex);
+            if (videoStreamIndex >= 0)
+                videoPacketQueue->pushEof(videoStreamIndex);
+            eof = true;
+            continue;
+        }
+        PipelineStats::instance()->record(PipelineStats::STAGE_DEMUX, Clock::nowMs() - readStart, 1, packet->size);
+        dispatch(packet);
+    }
+}
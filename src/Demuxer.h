@@ -0,0 +1,65 @@
+#pragma once
+#include "PacketQueue.h"
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+
+struct AVFormatContext;
+struct AVPacket;
+
+// 解复用器, 运行在独立线程中, 持续读取包并分发到音频/视频包队列
+// 队列达到上限时挂起等待(背压), 使磁盘/网络读取与解码并行且内存占用有界
+class Demuxer : public QObject
+{
+    Q_OBJECT
+signals:
+    void startDemux();
+
+private slots:
+    // 解复用循环, 直到stop()才退出; 读到文件末尾后向各队列写入结束包并等待跳转
+    void demuxPacket();
+
+private:
+    AVFormatContext *formatContext{nullptr};
+
+    PacketQueue *audioPacketQueue;
+    PacketQueue *videoPacketQueue;
+
+    int audioStreamIndex{-1};
+    int videoStreamIndex{-1};
+
+    std::atomic<bool> abortRequest{true};
+
+    // 跳转请求, 由waitMutex保护
+    bool seekRequest{false};
+    int seekStreamIndex{-1};
+    int64_t seekTimestamp{0};
+    int64_t seekBytePos{-1};
+    int64_t seekKeyframePts{0};
+
+    QMutex loopMutex; // 解复用循环运行期间持有, stop()借此等待循环退出
+    QMutex waitMutex;
+    QWaitCondition continueRead; // 队列出队/跳转/停止时唤醒解复用线程
+
+    // 所有在用队列都已满, 或总字节数超出硬上限
+    bool queuesAreFull() const;
+    // 按字节位置定位到关键帧, 读取落点后的包直到streamIndex的第一个包, 确认其不晚于keyframePts;
+    // 成功时读到的包按顺序存入packets, 失败时释放已读的包并返回false, 由调用方改按时间戳跳转
+    bool seekToKeyframe(int streamIndex, int64_t bytePos, int64_t keyframePts, QVector<AVPacket *> *packets);
+    // 按流分发一个包, 不读取的流的包直接释放
+    void dispatch(AVPacket *packet);
+
+public:
+    Demuxer(PacketQueue *audioQueue, PacketQueue *videoQueue, QObject *parent = nullptr);
+    ~Demuxer() = default;
+
+    // 开始解复用, streamIndex为-1的流不读取
+    void start(AVFormatContext *formatContext, int audioStreamIndex, int videoStreamIndex);
+    // 停止解复用, 阻塞直到解复用循环退出
+    void stop();
+    // 请求跳转, 立即清空包队列, 实际跳转在解复用线程中执行
+    // bytePos不小于0时按字节位置定位到pts为keyframePts的关键帧(来自关键帧索引), 失败或落点越过该关键帧时再按时间戳跳转
+    void seek(int streamIndex, int64_t timestamp, int64_t bytePos = -1, int64_t keyframePts = 0);
+};
@@ -0,0 +1,145 @@
+#include "FrameBufferPool.h"
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+}
+
+#define FRAME_BUFFER_ALIGN 64        // 行对齐, 满足SIMD与纹理上传
+#define FRAME_BUFFER_PADDING 64      // 尾部填充, 防止SIMD读越界
+#define MAX_IDLE_BUFFERS_PER_CLASS 8 // 每级最多保留的空闲缓冲数, 超出直接释放
+
+FrameBufferPool *FrameBufferPool::instance()
+{
+    static FrameBufferPool *pool = new FrameBufferPool();
+    return pool;
+}
+
+size_t FrameBufferPool::sizeClassOf(size_t size)
+{
+    // 每个2的幂区间分为8级, 向上取整浪费不超过12.5%
+    size_t pow2 = 4096;
+    while (pow2 < size)
+        pow2 <<= 1;
+    size_t step = pow2 >> 3;
+    return (size + step - 1) / step * step;
+}
+
+AVBufferRef *FrameBufferPool::acquire(size_t size)
+{
+    size_t classSize = sizeClassOf(size + FRAME_BUFFER_PADDING);
+
+    QMutexLocker locker(&mutex);
+    SizeClass *sizeClass = classes.value(classSize, nullptr);
+    if (sizeClass == nullptr)
+    {
+        sizeClass = new SizeClass{this, classSize, {}};
+        classes.insert(classSize, sizeClass);
+    }
+
+    uint8_t *data = nullptr;
+    if (!sizeClass->idle.isEmpty())
+    {
+        data = sizeClass->idle.takeLast();
+        idleBytes -= classSize;
+        hits++;
+    }
+    else
+    {
+        data = static_cast<uint8_t *>(av_malloc(classSize));
+        if (data == nullptr)
+            return nullptr;
+        residentBytes += classSize;
+        misses++;
+    }
+    locker.unlock();
+
+    AVBufferRef *buf = av_buffer_create(data, size, &FrameBufferPool::releaseBuffer, sizeClass, 0);
+    if (buf == nullptr)
+        releaseBuffer(sizeClass, data);
+    return buf;
+}
+
+void FrameBufferPool::releaseBuffer(void *opaque, uint8_t *data)
+{
+    SizeClass *sizeClass = static_cast<SizeClass *>(opaque);
+    FrameBufferPool *pool = sizeClass->pool;
+
+    QMutexLocker locker(&pool->mutex);
+    if (sizeClass->idle.size() < MAX_IDLE_BUFFERS_PER_CLASS)
+    {
+        sizeClass->idle.append(data);
+        pool->idleBytes += sizeClass->size;
+    }
+    else
+    {
+        av_free(data);
+        pool->residentBytes -= sizeClass->size;
+    }
+}
+
+int FrameBufferPool::getFrameBuffer(AVFrame *frame)
+{
+    AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+    if (format == AV_PIX_FMT_NONE || frame->width <= 0 || frame->height <= 0)
+        return AVERROR(EINVAL);
+
+    int linesizes[4] = {0};
+    int ret = av_image_fill_linesizes(linesizes, format, FFALIGN(frame->width, FRAME_BUFFER_ALIGN));
+    if (ret < 0)
+        return ret;
+
+    ptrdiff_t linesizes1[4];
+    for (int i = 0; i < 4; i++)
+    {
+        linesizes[i] = FFALIGN(linesizes[i], FRAME_BUFFER_ALIGN);
+        linesizes1[i] = linesizes[i];
+    }
+
+    size_t planeSizes[4] = {0};
+    ret = av_image_fill_plane_sizes(planeSizes, format, frame->height, linesizes1);
+    if (ret < 0)
+        return ret;
+
+    size_t totalSize = 0;
+    for (int i = 0; i < 4; i++)
+        totalSize += planeSizes[i];
+
+    AVBufferRef *buf = acquire(totalSize);
+    if (buf == nullptr)
+        return AVERROR(ENOMEM);
+
+    ret = av_image_fill_pointers(frame->data, format, frame->height, buf->data, linesizes);
+    if (ret < 0)
+    {
+        av_buffer_unref(&buf);
+        return ret;
+    }
+
+    for (int i = 0; i < 4; i++)
+        frame->linesize[i] = linesizes[i];
+    frame->buf[0] = buf;
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+void FrameBufferPool::trim()
+{
+    QMutexLocker locker(&mutex);
+    for (SizeClass *sizeClass : classes)
+    {
+        for (uint8_t *data : sizeClass->idle)
+        {
+            av_free(data);
+            residentBytes -= sizeClass->size;
+            idleBytes -= sizeClass->size;
+        }
+        sizeClass->idle.clear();
+    }
+}
+
+FrameBufferPool::Stats FrameBufferPool::getStats() const
+{
+    return {hits, misses, residentBytes, idleBytes};
+}
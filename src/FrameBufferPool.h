@@ -0,0 +1,65 @@
+#pragma once
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+// 按尺寸分级的帧缓冲池
+// 缓冲以AVBufferRef形式借出, 最后一个引用释放(av_frame_free/av_buffer_unref)时自动归还到所属级别的空闲链表
+// 渲染窗口持有的帧在替换时归还, 解码线程下一次申请同级缓冲即可复用, 稳定播放时不再有大块内存分配
+class FrameBufferPool
+{
+public:
+    struct Stats
+    {
+        int64_t hits;          // 从空闲链表取得
+        int64_t misses;        // 新分配
+        int64_t residentBytes; // 池分配且尚未释放的总字节数(含借出与空闲)
+        int64_t idleBytes;     // 空闲链表中的字节数
+    };
+
+private:
+    struct SizeClass
+    {
+        FrameBufferPool *pool;
+        size_t size;
+        QVector<uint8_t *> idle;
+    };
+
+    mutable QMutex mutex;
+    QMap<size_t, SizeClass *> classes;
+
+    std::atomic<int64_t> hits{0};
+    std::atomic<int64_t> misses{0};
+    std::atomic<int64_t> residentBytes{0};
+    std::atomic<int64_t> idleBytes{0};
+
+    FrameBufferPool() = default;
+
+    static size_t sizeClassOf(size_t size);
+    // AVBuffer释放回调, opaque为所属SizeClass
+    static void releaseBuffer(void *opaque, uint8_t *data);
+
+public:
+    FrameBufferPool(const FrameBufferPool &) = delete;
+    FrameBufferPool &operator=(const FrameBufferPool &) = delete;
+
+    // 缓冲可能在解码器销毁后仍被渲染窗口持有, 故池为进程级且不析构
+    static FrameBufferPool *instance();
+
+    // 借出至少size字节的缓冲, 失败返回nullptr
+    AVBufferRef *acquire(size_t size);
+    // 按frame的format/width/height分配池化的图像缓冲, 作用同av_frame_get_buffer, 成功返回0
+    int getFrameBuffer(AVFrame *frame);
+
+    // 释放所有空闲缓冲, 切换媒体或分辨率后调用
+    void trim();
+
+    Stats getStats() const;
+};
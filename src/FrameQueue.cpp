@@ -0,0 +1,126 @@
+#include "FrameQueue.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+void FrameQueue::start()
+{
+    QMutexLocker locker(&mutex);
+    abortRequest = false;
+}
+
+void FrameQueue::abort()
+{
+    QMutexLocker locker(&mutex);
+    abortRequest = true;
+    notEmpty.wakeAll();
+    notFull.wakeAll();
+}
+
+void FrameQueue::flush()
+{
+    QMutexLocker locker(&mutex);
+    clear();
+    notFull.wakeAll();
+}
+
+void FrameQueue::clear()
+{
+    while (!queue.isEmpty())
+    {
+        auto node = queue.dequeue();
+        av_frame_free(&node.frame);
+    }
+}
+
+bool FrameQueue::push(AVFrame *frame, double pts, int serial)
+{
+    QMutexLocker locker(&mutex);
+    while (!abortRequest && queue.size() >= maxSize)
+        notFull.wait(&mutex);
+
+    if (abortRequest)
+    {
+        av_frame_free(&frame);
+        return false;
+    }
+
+    queue.enqueue({frame, pts, serial});
+    notEmpty.wakeOne();
+    return true;
+}
+
+bool FrameQueue::pushFront(AVFrame *frame, double pts, int serial)
+{
+    QMutexLocker locker(&mutex);
+    if (abortRequest)
+    {
+        av_frame_free(&frame);
+        return false;
+    }
+
+    // 跳转后serial已过期的帧在下次出队时照常丢弃
+    queue.prepend({frame, pts, serial});
+    notEmpty.wakeOne();
+    return true;
+}
+
+AVFrame *FrameQueue::pop(double *pts, bool block, int *serial)
+{
+    return take(pts, serial, [block]() { return block; });
+}
+
+AVFrame *FrameQueue::popWhile(double *pts, const std::function<bool()> &waitWhile)
+{
+    return take(pts, nullptr, waitWhile);
+}
+
+void FrameQueue::wakeReaders()
+{
+    QMutexLocker locker(&mutex);
+    notEmpty.wakeAll();
+}
+
+AVFrame *FrameQueue::take(double *pts, int *serial, const std::function<bool()> &waitWhile)
+{
+    int currentSerial = packetQueue->getSerial();
+
+    QMutexLocker locker(&mutex);
+    while (!abortRequest)
+    {
+        while (!queue.isEmpty() && queue.head().serial != currentSerial)
+        { // 跳转前解码出的帧
+            auto node = queue.dequeue();
+            av_frame_free(&node.frame);
+            notFull.wakeOne();
+        }
+
+        if (!queue.isEmpty())
+        {
+            auto node = queue.dequeue();
+            notFull.wakeOne();
+            if (pts)
+                *pts = node.pts;
+            if (serial)
+                *serial = node.serial;
+            return node.frame;
+        }
+
+        if (!waitWhile())
+            break;
+
+        notEmpty.wait(&mutex);
+        locker.unlock();
+        currentSerial = packetQueue->getSerial();
+        locker.relock();
+    }
+    return nullptr;
+}
+
+int FrameQueue::count() const
+{
+    QMutexLocker locker(&mutex);
+    return queue.size();
+}
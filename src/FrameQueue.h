@@ -0,0 +1,58 @@
+#pragma once
+#include "PacketQueue.h"
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+#include <functional>
+
+struct AVFrame;
+
+// 有界解码帧队列, 由解码线程写入, 同步/显示线程读取; 队列满时写入阻塞, 形成对解码的背压
+// 每帧记录其来源包的serial, 与包队列serial不一致的帧(跳转前解码出的帧)在出队时丢弃
+class FrameQueue
+{
+private:
+    struct FrameNode
+    {
+        AVFrame *frame;
+        double pts; // 显示时间戳(ms)
+        int serial;
+    };
+
+    QQueue<FrameNode> queue;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+
+    PacketQueue *packetQueue;
+    const int maxSize;
+    bool abortRequest{true};
+
+    void clear();
+    AVFrame *take(double *pts, int *serial, const std::function<bool()> &waitWhile);
+
+public:
+    FrameQueue(PacketQueue *packetQueue, int maxSize) : packetQueue(packetQueue), maxSize(maxSize) {}
+    ~FrameQueue() { clear(); }
+
+    void start();
+    // 中止队列, 唤醒所有阻塞在push/pop上的线程
+    void abort();
+    // 释放队列中所有帧
+    void flush();
+
+    // 入队并取得frame所有权, 队列满时阻塞; 队列已中止时释放frame并返回false
+    bool push(AVFrame *frame, double pts, int serial);
+    // 将已出队但未显示的帧放回队首, 不受容量限制也不阻塞; 队列已中止时释放frame并返回false
+    bool pushFront(AVFrame *frame, double pts, int serial);
+    // 出队, block为true时队列为空则阻塞等待; 队列中止或为空(非阻塞)时返回nullptr
+    // serial非空时输出该帧所属的serial
+    AVFrame *pop(double *pts, bool block = true, int *serial = nullptr);
+    // 出队, 队列为空时在waitWhile返回true期间阻塞等待; waitWhile在队列锁内检查, 其依赖的状态改变后须调用wakeReaders
+    // 队列中止或为空且waitWhile返回false时返回nullptr
+    AVFrame *popWhile(double *pts, const std::function<bool()> &waitWhile);
+    // 唤醒阻塞在popWhile上的线程重新检查等待条件
+    void wakeReaders();
+
+    int count() const;
+};
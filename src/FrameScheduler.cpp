@@ -0,0 +1,74 @@
+#include "FrameScheduler.h"
+#include "MediaClock.h"
+#include "TraceWriter.h"
+#include <QThread>
+#include <QtGlobal>
+#include <cmath>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+#define OVERSHOOT_SMOOTHING 0.125 // 唤醒超时指数平均的权重
+#define MIN_SPIN_MARGIN_MS 0.5    // 自旋余量下限(ms)
+#define MAX_SPIN_MARGIN_MS 4.0    // 自旋余量上限(ms)
+
+FrameScheduler::TimerResolutionGuard::TimerResolutionGuard()
+{
+#ifdef _WIN32
+    timeBeginPeriod(1); // 默认定时器精度约15.6ms, 挂起等待会严重超时
+#endif
+}
+
+FrameScheduler::TimerResolutionGuard::~TimerResolutionGuard()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+bool FrameScheduler::waitUntil(double deadlineMs)
+{
+    // 粗等待: 挂起至目标时刻前spinMarginMs, 条件变量只有整毫秒精度; 提前唤醒时继续挂起
+    double now = Clock::nowMs();
+    double sleepMs = deadlineMs - spinMarginMs - now;
+    while (sleepMs >= 1.0)
+    {
+        double wakeTarget = now + std::floor(sleepMs);
+        bool playing = control->waitWhileState(CONTL_TYPE::PLAY, static_cast<unsigned long>(sleepMs));
+        TraceWriter::span("sleep", now);
+        if (!playing)
+            return false;
+
+        // 超时唤醒的偏差用于调整自旋余量, 余量取平均超时的两倍
+        now = Clock::nowMs();
+        double overshoot = now - wakeTarget;
+        if (overshoot > 0)
+        {
+            sleepOvershootMs += (overshoot - sleepOvershootMs) * OVERSHOOT_SMOOTHING;
+            spinMarginMs = qBound(MIN_SPIN_MARGIN_MS, sleepOvershootMs * 2, MAX_SPIN_MARGIN_MS);
+        }
+        sleepMs = deadlineMs - spinMarginMs - now;
+    }
+
+    // 精等待: 让出时间片自旋, 每轮检查播放状态
+    TraceSpan span("spin");
+    while (Clock::nowMs() < deadlineMs)
+    {
+        if (control->getState() != CONTL_TYPE::PLAY)
+            return false;
+        QThread::yieldCurrentThread();
+    }
+    return control->getState() == CONTL_TYPE::PLAY;
+}
+
+void FrameScheduler::recordPresent(double deadlineMs)
+{
+    lateness.record(std::llround((Clock::nowMs() - deadlineMs) * 1000.0));
+}
+
+void FrameScheduler::reset()
+{
+    lateness.reset();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "Histogram.h"
+#include "PlayerControl.h"
+#include <atomic>
+
+// 帧呈现调度: 按单调时钟的目标时刻输出帧, 亚毫秒级精度
+// 等待分两段: 距目标较远时挂起在播放状态条件变量上(暂停/停止立即唤醒), 剩余spinMarginMs内让出时间片自旋到目标时刻
+// 系统定时器的唤醒超时随负载变化, 以指数平均估计并据此调整自旋余量, 兼顾精度与CPU占用
+class FrameScheduler
+{
+private:
+    const PlayerControl *control;
+
+    double spinMarginMs = 2.0;   // 仅呈现线程访问
+    double sleepOvershootMs = 0; // 挂起唤醒超时的指数平均(ms)
+
+    Histogram lateness; // 每帧实际输出时刻与目标时刻之差(us), 负值为提前
+
+public:
+    // 作用域内提高系统定时器精度(Windows下为1ms), 播放期间持有
+    class TimerResolutionGuard
+    {
+    public:
+        TimerResolutionGuard();
+        ~TimerResolutionGuard();
+        TimerResolutionGuard(const TimerResolutionGuard &) = delete;
+        TimerResolutionGuard &operator=(const TimerResolutionGuard &) = delete;
+    };
+
+    explicit FrameScheduler(const PlayerControl *control) : control(control) {}
+
+    // 等待至单调时刻deadlineMs(Clock::nowMs时间轴), 已过期时立即返回; 离开播放状态时提前返回false
+    bool waitUntil(double deadlineMs);
+    // 帧已输出, 记录相对目标时刻的延迟
+    void recordPresent(double deadlineMs);
+
+    const Histogram &getLatenessHistogram() const { return lateness; }
+    double getSpinMarginMs() const { return spinMarginMs; }
+    void reset();
+};
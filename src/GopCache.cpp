@@ -0,0 +1,305 @@
+#include "GopCache.h"
+#include "FrameBufferPool.h"
+#include "ProbeCache.h"
+#include <QDebug>
+#include <iterator>
+#include <utility>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#define GOP_DECODE_THREADS 0     // 自动选择线程数, 倒放是否流畅取决于一段GOP的解码速度
+#define GOP_SEEK_BACKOFF_MS 1000 // 跳转落在目标所在的GOP时, 向前加大的跳转距离, 每次翻倍
+#define GOP_SEEK_ATTEMPTS 4      // 向前加大跳转距离的次数上限
+
+void GopCache::insert(int64_t pts, AVFrame *frame, int64_t prevPts)
+{
+    auto it = frames.find(pts);
+    if (it != frames.end())
+    {
+        av_frame_free(&frame); // 已缓存, 只补充相邻关系
+    }
+    else
+    {
+        if (frame == nullptr)
+            return;
+        int64_t size = av_image_get_buffer_size(AVPixelFormat(frame->format), frame->width, frame->height, 1);
+        it = frames.emplace(pts, Entry{frame, size, AV_NOPTS_VALUE}).first;
+        totalBytes += size;
+    }
+
+    if (prevPts == AV_NOPTS_VALUE || prevPts >= pts)
+        return;
+    auto prevIt = frames.find(prevPts);
+    if (prevIt != frames.end())
+        prevIt->second.next = pts;
+}
+
+void GopCache::trim(int64_t focusPts)
+{
+    int64_t budget = budgetBytes;
+    while (totalBytes > budget && !frames.empty())
+    {
+        auto first = frames.begin();
+        auto last = std::prev(frames.end());
+        erase(focusPts - first->first >= last->first - focusPts ? first : last);
+    }
+}
+
+void GopCache::erase(std::map<int64_t, Entry>::iterator it)
+{
+    av_frame_free(&it->second.frame);
+    totalBytes -= it->second.bytes;
+    frames.erase(it);
+}
+
+void GopCache::clear()
+{
+    for (auto &entry : frames)
+        av_frame_free(&entry.second.frame);
+    frames.clear();
+    totalBytes = 0;
+}
+
+const AVFrame *GopCache::find(int64_t pts) const
+{
+    auto it = frames.find(pts);
+    return it != frames.end() ? it->second.frame : nullptr;
+}
+
+int64_t GopCache::prev(int64_t pts) const
+{
+    // 比pts小的最后一帧, 其后一帧正是pts时两者相邻
+    auto it = frames.lower_bound(pts);
+    if (it == frames.begin())
+        return AV_NOPTS_VALUE;
+    --it;
+    return it->second.next == pts ? it->first : AV_NOPTS_VALUE;
+}
+
+int64_t GopCache::next(int64_t pts) const
+{
+    auto it = frames.find(pts);
+    if (it == frames.end() || it->second.next == AV_NOPTS_VALUE || frames.count(it->second.next) == 0)
+        return AV_NOPTS_VALUE;
+    return it->second.next;
+}
+
+int GopDecoder::interruptCallback(void *opaque)
+{
+    // 只在暂停时逐帧/倒放使用, 开始播放或停止后不再需要
+    const GopDecoder *decoder = static_cast<const GopDecoder *>(opaque);
+    return decoder->control->getState() != CONTL_TYPE::PAUSE ? 1 : 0;
+}
+
+bool GopDecoder::open(const QString &mediaPath, int _streamIndex, AVPixelFormat _dstFormat)
+{
+    close();
+    formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = this;
+    if (avformat_open_input(&formatContext, mediaPath.toUtf8().constData(), nullptr, nullptr) != 0)
+        return false; // 失败时formatContext已被释放并置空
+
+    // 播放器打开时已写入探测缓存, 命中时无需再次探测
+    ProbeCache::Entry entry;
+    bool probed = ProbeCache::load(mediaPath, &entry) && ProbeCache::apply(entry, formatContext) && ProbeCache::isComplete(formatContext);
+    if ((!probed && avformat_find_stream_info(formatContext, nullptr) < 0) ||
+        _streamIndex < 0 || _streamIndex >= static_cast<int>(formatContext->nb_streams))
+    {
+        close();
+        return false;
+    }
+
+    // 只读视频流, 其余流的包由解复用器直接丢弃
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+        formatContext->streams[i]->discard = static_cast<int>(i) == _streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    AVStream *stream = formatContext->streams[_streamIndex];
+
+    const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (codec == nullptr)
+    {
+        close();
+        return false;
+    }
+    codecContext = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecContext, stream->codecpar);
+    codecContext->pkt_timebase = stream->time_base;
+    codecContext->thread_count = GOP_DECODE_THREADS;
+    if (avcodec_open2(codecContext, codec, nullptr) < 0)
+    {
+        close();
+        return false;
+    }
+
+    streamIndex = _streamIndex;
+    dstFormat = _dstFormat;
+    startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    return true;
+}
+
+void GopDecoder::close()
+{
+    if (swsContext)
+    {
+        sws_freeContext(swsContext);
+        swsContext = nullptr;
+    }
+    if (codecContext)
+        avcodec_free_context(&codecContext);
+    if (formatContext)
+        avformat_close_input(&formatContext);
+    streamIndex = -1;
+}
+
+template <typename Accept>
+void GopDecoder::decodeFrom(int64_t seekPts, Accept accept)
+{
+    avcodec_flush_buffers(codecContext);
+    if (av_seek_frame(formatContext, streamIndex, seekPts, AVSEEK_FLAG_BACKWARD) < 0)
+        return;
+
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    bool accepting = true;
+    while (accepting && control->getState() == CONTL_TYPE::PAUSE)
+    {
+        int ret = avcodec_receive_frame(codecContext, frame);
+        if (ret >= 0)
+        {
+            int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE)
+                accepting = accept(frame, pts);
+            av_frame_unref(frame);
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN)) // 冲刷完毕或解码出错
+            break;
+
+        // 读到文件末尾时送入空包, 取出解码器中缓存的帧
+        if (av_read_frame(formatContext, packet) < 0)
+        {
+            avcodec_send_packet(codecContext, nullptr);
+            continue;
+        }
+        if (packet->stream_index == streamIndex)
+            avcodec_send_packet(codecContext, packet);
+        av_packet_unref(packet);
+    }
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+}
+
+AVFrame *GopDecoder::convert(const AVFrame *frame)
+{
+    if (frame->format == dstFormat)
+        return av_frame_clone(frame);
+
+    swsContext = sws_getCachedContext(swsContext, frame->width, frame->height, AVPixelFormat(frame->format),
+                                      frame->width, frame->height, dstFormat, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    AVFrame *dstFrame = av_frame_alloc();
+    dstFrame->format = dstFormat;
+    dstFrame->width = frame->width;
+    dstFrame->height = frame->height;
+    if (swsContext == nullptr || FrameBufferPool::instance()->getFrameBuffer(dstFrame) < 0)
+    {
+        av_frame_free(&dstFrame);
+        return nullptr;
+    }
+    sws_scale(swsContext, frame->data, frame->linesize, 0, frame->height, dstFrame->data, dstFrame->linesize);
+    return dstFrame;
+}
+
+int GopDecoder::storeWindow(GopCache *cache, FrameWindow &window, int64_t prevPts)
+{
+    int stored = 0;
+    for (auto &item : window)
+    {
+        bool cached = cache->find(item.first) != nullptr;
+        AVFrame *frame = cached ? nullptr : convert(item.second);
+        av_frame_free(&item.second);
+        if (!cached && frame == nullptr)
+        { // 转换失败, 相邻关系在此中断
+            prevPts = AV_NOPTS_VALUE;
+            continue;
+        }
+        cache->insert(item.first, frame, prevPts);
+        prevPts = item.first;
+        stored++;
+    }
+    window.clear();
+    return stored;
+}
+
+int64_t GopDecoder::frameBytes(const AVFrame *frame) const
+{
+    return av_image_get_buffer_size(dstFormat, frame->width, frame->height, 1);
+}
+
+int GopDecoder::decodeBefore(int64_t pts, GopCache *cache, int64_t windowBytes)
+{
+    if (!isOpen())
+        return 0;
+
+    // 解到pts为止, 窗口超出大小时丢弃最早的帧; pts本身不是一帧时以其后第一帧结束
+    FrameWindow window;
+    int64_t size = 0;
+    auto accept = [&](const AVFrame *frame, int64_t framePts)
+    {
+        if (!window.empty() && framePts <= window.back().first)
+            return true; // 时间戳乱序的帧无法确定相邻关系
+        window.push_back({framePts, av_frame_clone(frame)});
+        size += frameBytes(frame);
+        while (size > windowBytes && window.size() > 2) // 至少保留pts与其前一帧
+        {
+            size -= frameBytes(window.front().second);
+            av_frame_free(&window.front().second);
+            window.pop_front();
+        }
+        return framePts < pts;
+    };
+
+    // 按pts - 1跳转: pts为关键帧时落到上一个GOP; 没有解出pts之前的帧说明仍落在了pts所在的GOP, 加大距离重试
+    AVRational timeBase = formatContext->streams[streamIndex]->time_base;
+    int64_t backoff = av_rescale_q(GOP_SEEK_BACKOFF_MS, AVRational{1, 1000}, timeBase);
+    int64_t seekPts = pts - 1;
+    for (int attempt = 0; attempt < GOP_SEEK_ATTEMPTS; attempt++)
+    {
+        decodeFrom(seekPts, accept);
+        if (control->getState() != CONTL_TYPE::PAUSE || (!window.empty() && window.front().first < pts) || seekPts <= startTime)
+            break;
+        for (auto &item : window)
+            av_frame_free(&item.second);
+        window.clear();
+        size = 0;
+        seekPts = pts - backoff;
+        backoff *= 2;
+    }
+    return storeWindow(cache, window, AV_NOPTS_VALUE);
+}
+
+int GopDecoder::decodeAfter(int64_t pts, GopCache *cache, int64_t windowBytes)
+{
+    if (!isOpen())
+        return 0;
+
+    // 从pts所在GOP的关键帧解起, 跳过pts之前的帧, 窗口满时停止
+    FrameWindow window;
+    int64_t size = 0;
+    auto accept = [&](const AVFrame *frame, int64_t framePts)
+    {
+        if (framePts < pts || (!window.empty() && framePts <= window.back().first))
+            return true;
+        window.push_back({framePts, av_frame_clone(frame)});
+        size += frameBytes(frame);
+        return size < windowBytes || window.size() < 2;
+    };
+    decodeFrom(pts, accept);
+    // pts本身不在窗口中(不是一帧的时间戳)时, 第一帧仍接在已缓存的pts之后
+    return storeWindow(cache, window, pts);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "PlayerControl.h"
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <utility>
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct SwsContext;
+
+// 已解码帧缓存, 供暂停时逐帧前进/后退与倒放取用; 帧为渲染格式(硬解NV12, 软解YUV420P), 按pts(流时间基)索引
+// 每帧记录解码顺序上紧接其后的帧, 只有确知相邻的两帧才能互相步进, 丢帧/跳转造成的间隔不会被跨过
+// 总大小超出预算时淘汰离当前位置最远的帧; 只在视频解码线程访问
+class GopCache
+{
+private:
+    struct Entry
+    {
+        AVFrame *frame;
+        int64_t bytes;
+        int64_t next; // 后一帧的pts, 未知时为AV_NOPTS_VALUE
+    };
+
+    std::map<int64_t, Entry> frames;
+    int64_t totalBytes{0};
+    std::atomic<int64_t> budgetBytes;
+
+    void erase(std::map<int64_t, Entry>::iterator it);
+
+public:
+    explicit GopCache(int64_t budgetBytes) : budgetBytes(budgetBytes) {}
+    ~GopCache() { clear(); }
+    GopCache(const GopCache &) = delete;
+    GopCache &operator=(const GopCache &) = delete;
+
+    // 任意线程调用, 下一次插入时生效; 0表示不缓存
+    void setBudget(int64_t bytes) { budgetBytes = bytes; }
+    int64_t getBudget() const { return budgetBytes; }
+
+    // 取得frame所有权; prevPts为解码顺序上紧接在前的帧, 已缓存时建立相邻关系
+    void insert(int64_t pts, AVFrame *frame, int64_t prevPts);
+    // 超出预算时淘汰离focusPts最远的帧
+    void trim(int64_t focusPts);
+    void clear();
+
+    const AVFrame *find(int64_t pts) const;
+    // 紧接在pts之前/之后且已缓存的帧, 没有时返回AV_NOPTS_VALUE
+    int64_t prev(int64_t pts) const;
+    int64_t next(int64_t pts) const;
+
+    int count() const { return static_cast<int>(frames.size()); }
+    int64_t bytes() const { return totalBytes; }
+};
+
+// 为GopCache解码一段连续的帧, 使用独立的AVFormatContext与软件解码器, 不影响播放解码器的位置
+// 从目标之前最近的关键帧开始解码整段GOP, 只保留目标附近不超过窗口大小的帧; 离开暂停状态时中止
+class GopDecoder
+{
+private:
+    typedef std::deque<std::pair<int64_t, AVFrame *>> FrameWindow; // 解码出的帧与其pts, 尚未转换
+
+    const PlayerControl *control;
+    AVFormatContext *formatContext{nullptr};
+    AVCodecContext *codecContext{nullptr};
+    SwsContext *swsContext{nullptr}; // 转为渲染格式, 尺寸/格式不变时复用
+    int streamIndex{-1};
+    AVPixelFormat dstFormat{AV_PIX_FMT_NONE};
+    int64_t startTime{0};
+
+    static int interruptCallback(void *opaque);
+
+    // 跳转到seekPts之前最近的关键帧, 按显示顺序解码, 每帧交给accept(frame, pts); accept返回false时停止
+    template <typename Accept>
+    void decodeFrom(int64_t seekPts, Accept accept);
+    // 转为渲染格式, 失败时返回nullptr
+    AVFrame *convert(const AVFrame *frame);
+    // 转换后的大小
+    int64_t frameBytes(const AVFrame *frame) const;
+    // 按显示顺序转换并存入一段帧, 相邻两帧建立相邻关系, 已缓存的帧不再转换; 释放window中的帧, 返回存入的帧数
+    int storeWindow(GopCache *cache, FrameWindow &window, int64_t prevPts);
+
+public:
+    explicit GopDecoder(const PlayerControl *control) : control(control) {}
+    ~GopDecoder() { close(); }
+    GopDecoder(const GopDecoder &) = delete;
+    GopDecoder &operator=(const GopDecoder &) = delete;
+
+    bool open(const QString &mediaPath, int streamIndex, AVPixelFormat dstFormat);
+    void close();
+    bool isOpen() const { return codecContext != nullptr; }
+
+    // 解码pts及其之前的连续帧存入cache, 保留最靠近pts且总大小不超过windowBytes的部分; 返回存入的帧数
+    int decodeBefore(int64_t pts, GopCache *cache, int64_t windowBytes);
+    // 解码pts及其之后的连续帧存入cache, 总大小不超过windowBytes; 返回存入的帧数
+    int decodeAfter(int64_t pts, GopCache *cache, int64_t windowBytes);
+};
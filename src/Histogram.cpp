@@ -0,0 +1,105 @@
+#include "Histogram.h"
+#include <cmath>
+
+int Histogram::bucketIndex(int64_t value)
+{
+    if (value < LINEAR_BUCKETS)
+        return value < 0 ? 0 : static_cast<int>(value);
+
+    int exponent = 63;
+    while (!(static_cast<uint64_t>(value) >> exponent))
+        exponent--;
+    if (exponent > MAX_EXPONENT)
+        return BUCKET_COUNT - 1;
+
+    // value位于[2^e, 2^(e+1)), 右移e-3位后落在[8, 16)
+    int sub = static_cast<int>(value >> (exponent - 3)) - SUB_BUCKETS;
+    return LINEAR_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub;
+}
+
+int64_t Histogram::bucketUpperBound(int index)
+{
+    if (index < LINEAR_BUCKETS)
+        return index;
+
+    int exponent = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+    int sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    int64_t width = int64_t(1) << (exponent - 3);
+    return (SUB_BUCKETS + sub) * width + width - 1;
+}
+
+void Histogram::record(int64_t value)
+{
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    totalCount.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    int64_t cur = minValue.load(std::memory_order_relaxed);
+    while (value < cur && !minValue.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+        ;
+    cur = maxValue.load(std::memory_order_relaxed);
+    while (value > cur && !maxValue.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+        ;
+}
+
+void Histogram::reset()
+{
+    for (auto &bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    totalCount.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minValue.store(INT64_MAX, std::memory_order_relaxed);
+    maxValue.store(INT64_MIN, std::memory_order_relaxed);
+}
+
+int64_t Histogram::min() const
+{
+    return count() > 0 ? minValue.load(std::memory_order_relaxed) : 0;
+}
+
+int64_t Histogram::max() const
+{
+    return count() > 0 ? maxValue.load(std::memory_order_relaxed) : 0;
+}
+
+double Histogram::mean() const
+{
+    int64_t n = count();
+    return n > 0 ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+int64_t Histogram::percentile(double p) const
+{
+    int64_t n = 0;
+    for (const auto &bucket : buckets)
+        n += bucket.load(std::memory_order_relaxed);
+    if (n == 0)
+        return 0;
+
+    int64_t target = static_cast<int64_t>(std::ceil(p / 100.0 * n));
+    if (target < 1)
+        target = 1;
+
+    int64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            int64_t maxV = max();
+            if (i == BUCKET_COUNT - 1) // 溢出桶没有上界
+                return maxV;
+            int64_t upper = bucketUpperBound(i);
+            return upper < maxV ? upper : maxV;
+        }
+    }
+    return max();
+}
+
+QString Histogram::summary() const
+{
+    return QString::asprintf("n=%lld min=%lld p50=%lld p90=%lld p99=%lld max=%lld mean=%.1f",
+                             static_cast<long long>(count()), static_cast<long long>(min()),
+                             static_cast<long long>(percentile(50)), static_cast<long long>(percentile(90)),
+                             static_cast<long long>(percentile(99)), static_cast<long long>(max()), mean());
+}
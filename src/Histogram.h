@@ -0,0 +1,44 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+// 对数-线性分桶直方图(类似HdrHistogram): 小于16的值各占一桶, 之后每个2的幂区间均分为8桶, 相对误差不超过12.5%
+// 计数均为原子量, 任意线程可并发记录与读取, 记录无锁且不分配内存
+class Histogram
+{
+private:
+    static const int LINEAR_BUCKETS = 16;
+    static const int SUB_BUCKETS = 8;       // 每个2的幂区间的桶数
+    static const int MAX_EXPONENT = 40;     // 最大可区分的值约为2^41, 更大的值计入最后一桶
+    static const int BUCKET_COUNT = LINEAR_BUCKETS + (MAX_EXPONENT - 4 + 1) * SUB_BUCKETS;
+
+    std::atomic<int64_t> buckets[BUCKET_COUNT];
+    std::atomic<int64_t> totalCount{0};
+    std::atomic<int64_t> sum{0};
+    std::atomic<int64_t> minValue{INT64_MAX};
+    std::atomic<int64_t> maxValue{INT64_MIN};
+
+    static int bucketIndex(int64_t value);
+    static int64_t bucketUpperBound(int index);
+
+public:
+    Histogram() { reset(); }
+    Histogram(const Histogram &) = delete;
+    Histogram &operator=(const Histogram &) = delete;
+
+    // 记录一个值, 负值计入第一个桶(min/mean仍按原值统计)
+    void record(int64_t value);
+    // 清零, 与record并发时可能丢失少量计数
+    void reset();
+
+    int64_t count() const { return totalCount.load(std::memory_order_relaxed); }
+    int64_t min() const;
+    int64_t max() const;
+    double mean() const;
+    // 第p百分位(0~100)的近似值(所在桶的上界, 不超过max), 无记录时返回0
+    int64_t percentile(double p) const;
+
+    // 计数与常用分位数, 用于日志输出
+    QString summary() const;
+};
@@ -0,0 +1,196 @@
+#include "KeyframeIndex.h"
+#include "MediaClock.h"
+#include "ProbeCache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#define KEYFRAME_INDEX_MAGIC "KFINDEX1"
+#define KEYFRAME_INDEX_VERSION 1
+
+// 索引文件头, 之后紧跟count个Entry; 各字段按8字节对齐, 映射后可直接访问
+struct KeyframeIndexHeader
+{
+    char magic[8];
+    int32_t version;
+    int32_t streamIndex;
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    int64_t count;
+};
+static_assert(sizeof(KeyframeIndexHeader) == 32, "index header layout changed");
+static_assert(sizeof(KeyframeIndex::Entry) == 24, "index entry layout changed");
+
+QString KeyframeIndex::indexPath(const QString &mediaPath)
+{
+    QString key = ProbeCache::fileKey(mediaPath);
+    if (key.isEmpty())
+        return QString();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/keyframes/" + key + ".kfi";
+}
+
+bool KeyframeIndex::isSupported(const AVFormatContext *formatContext)
+{
+    // 同ffplay: 只有TS这类时间戳不连续的格式按字节定位能落在指定的包上;
+    // MKV/AVI/FLV按字节定位后会重新同步到下一个簇/块, 落点晚于索引中的关键帧, Ogg则按页同步
+    if (formatContext == nullptr || formatContext->pb == nullptr)
+        return false;
+    const AVInputFormat *format = formatContext->iformat;
+    return !(format->flags & AVFMT_NO_BYTE_SEEK) && (format->flags & AVFMT_TS_DISCONT) && std::strcmp(format->name, "ogg") != 0;
+}
+
+bool KeyframeIndex::load(const QString &mediaPath, int _streamIndex)
+{
+    close();
+    QString path = indexPath(mediaPath);
+    if (path.isEmpty())
+        return false;
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    if (file.size() < static_cast<qint64>(sizeof(KeyframeIndexHeader)))
+    {
+        file.close();
+        return false;
+    }
+
+    mapped = file.map(0, file.size());
+    if (mapped == nullptr)
+    {
+        file.close();
+        return false;
+    }
+
+    const KeyframeIndexHeader *header = reinterpret_cast<const KeyframeIndexHeader *>(mapped);
+    qint64 expectedSize = sizeof(KeyframeIndexHeader) + header->count * static_cast<qint64>(sizeof(Entry));
+    if (std::memcmp(header->magic, KEYFRAME_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->version != KEYFRAME_INDEX_VERSION ||
+        header->streamIndex != _streamIndex || header->count <= 0 || file.size() != expectedSize)
+    {
+        close();
+        return false;
+    }
+
+    entries = reinterpret_cast<const Entry *>(mapped + sizeof(KeyframeIndexHeader));
+    entryCount = header->count;
+    streamIndex = _streamIndex;
+    qDebug() << "keyframe index loaded, keyframes:" << entryCount;
+    return true;
+}
+
+void KeyframeIndex::close()
+{
+    if (mapped)
+        file.unmap(mapped);
+    if (file.isOpen())
+        file.close();
+    mapped = nullptr;
+    entries = nullptr;
+    entryCount = 0;
+    streamIndex = -1;
+}
+
+const KeyframeIndex::Entry *KeyframeIndex::find(int64_t timestamp) const
+{
+    if (!entries)
+        return nullptr;
+
+    // 第一个pts大于timestamp的关键帧的前一个
+    int64_t low = 0, high = entryCount;
+    while (low < high)
+    {
+        int64_t mid = low + (high - low) / 2;
+        if (entries[mid].pts <= timestamp)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return &entries[low > 0 ? low - 1 : 0];
+}
+
+int KeyframeIndexer::interruptCallback(void *opaque)
+{
+    // opaque指向本次扫描的序号, 与当前序号不同说明已被取消
+    const std::pair<KeyframeIndexer *, int> *request = static_cast<const std::pair<KeyframeIndexer *, int> *>(opaque);
+    return request->first->currentSerial != request->second ? 1 : 0;
+}
+
+void KeyframeIndexer::build(const QString &mediaPath, int streamIndex, int serial)
+{
+    if (serial != currentSerial)
+        return;
+    QString path = KeyframeIndex::indexPath(mediaPath);
+    if (path.isEmpty())
+        return;
+
+    double start = Clock::nowMs();
+    std::pair<KeyframeIndexer *, int> request(this, serial);
+    AVFormatContext *formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = &request;
+    if (avformat_open_input(&formatContext, mediaPath.toUtf8().constData(), nullptr, nullptr) != 0)
+        return;
+    if (streamIndex < 0 || streamIndex >= static_cast<int>(formatContext->nb_streams))
+    {
+        avformat_close_input(&formatContext);
+        return;
+    }
+
+    // 只读目标流, 其余流的包由解复用器直接丢弃
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+        formatContext->streams[i]->discard = static_cast<int>(i) == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    AVStream *stream = formatContext->streams[streamIndex];
+
+    QVector<KeyframeIndex::Entry> entries;
+    AVPacket *packet = av_packet_alloc();
+    while (serial == currentSerial && av_read_frame(formatContext, packet) >= 0)
+    {
+        int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY) && packet->pos >= 0 && pts != AV_NOPTS_VALUE)
+            entries.append({pts, packet->pos, packet->size, 0});
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    KeyframeIndexHeader header;
+    std::memcpy(header.magic, KEYFRAME_INDEX_MAGIC, sizeof(header.magic));
+    header.version = KEYFRAME_INDEX_VERSION;
+    header.streamIndex = streamIndex;
+    header.timeBaseNum = stream->time_base.num;
+    header.timeBaseDen = stream->time_base.den;
+    avformat_close_input(&formatContext);
+
+    if (serial != currentSerial || entries.isEmpty())
+        return;
+
+    // B帧等导致关键帧的pts不一定按读取顺序递增, 排序后才能二分查找
+    std::sort(entries.begin(), entries.end(), [](const KeyframeIndex::Entry &a, const KeyframeIndex::Entry &b)
+              { return a.pts < b.pts; });
+    header.count = entries.size();
+
+    if (!QDir().mkpath(QFileInfo(path).absolutePath()))
+        return;
+    QSaveFile file(path); // 先写临时文件再替换, 读取方不会映射到写了一半的索引
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(KeyframeIndex::Entry));
+    if (!file.commit())
+    {
+        qDebug() << "keyframe index write failed:" << path;
+        return;
+    }
+
+    qDebug() << "keyframe index built, keyframes:" << entries.size() << "time(ms):" << Clock::nowMs() - start;
+    emit indexBuilt(mediaPath, streamIndex);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+struct AVFormatContext;
+
+// 关键帧索引: 记录一个流中每个关键帧的pts, 文件内字节位置与包大小, 按pts升序保存为紧凑的二进制文件
+// 跳转时按pts二分查找到目标之前最近的关键帧, 按字节位置直接定位, 不依赖容器自带的索引
+// (TS等没有索引的格式, av_seek_frame只能二分读取, 慢且落点粗)
+// 索引文件以内存映射方式加载, 再次打开同一文件时无需重新扫描
+class KeyframeIndex
+{
+public:
+    struct Entry
+    {
+        int64_t pts; // 流时间基
+        int64_t pos; // 包在文件中的字节位置
+        int32_t size;
+        int32_t reserved;
+    };
+
+private:
+    QFile file;
+    uchar *mapped{nullptr};
+    const Entry *entries{nullptr};
+    int64_t entryCount{0};
+    int streamIndex{-1};
+
+public:
+    KeyframeIndex() = default;
+    ~KeyframeIndex() { close(); }
+    KeyframeIndex(const KeyframeIndex &) = delete;
+    KeyframeIndex &operator=(const KeyframeIndex &) = delete;
+
+    // 索引文件路径, 与探测缓存使用同一文件键, 非本地文件返回空
+    static QString indexPath(const QString &mediaPath);
+    // 该格式能否按字节位置准确跳转到关键帧(只有TS这类格式; MP4等自带完整索引的格式无需建立索引)
+    static bool isSupported(const AVFormatContext *formatContext);
+
+    // 映射mediaPath对应的索引文件, 文件不存在/已失效/流不一致时返回false
+    bool load(const QString &mediaPath, int streamIndex);
+    void close();
+
+    bool isLoaded() const { return entries != nullptr; }
+    int64_t count() const { return entryCount; }
+    int getStreamIndex() const { return streamIndex; }
+    // pts不大于timestamp的最后一个关键帧, 早于第一个关键帧时返回第一个, 未加载时返回nullptr
+    const Entry *find(int64_t timestamp) const;
+};
+
+// 后台建立关键帧索引, 运行在独立的低优先级线程中
+// 使用独立的AVFormatContext只读包不解码, 读完后写出索引文件
+class KeyframeIndexer : public QObject
+{
+    Q_OBJECT
+signals:
+    // 索引文件已写出, 可由KeyframeIndex::load加载
+    void indexBuilt(const QString &mediaPath, int streamIndex);
+
+public slots:
+    // 扫描mediaPath中streamIndex流的关键帧, serial已过期(被cancel)时中止
+    void build(const QString &mediaPath, int streamIndex, int serial);
+
+private:
+    std::atomic<int> currentSerial{0};
+
+    static int interruptCallback(void *opaque);
+
+public:
+    explicit KeyframeIndexer(QObject *parent = nullptr) : QObject(parent) {}
+
+    // 任意线程调用, 返回新请求的序号, 同时使进行中的扫描失效
+    int nextSerial() { return ++currentSerial; }
+    // 任意线程调用, 中止进行中的扫描
+    void cancel() { ++currentSerial; }
+};
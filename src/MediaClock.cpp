@@ -0,0 +1,143 @@
+#include "MediaClock.h"
+#include <chrono>
+#include <cmath>
+
+#define NOSYNC_THRESHOLD_MS 10000.0 // 时钟相差超过此值不再尝试同步, 直接对齐
+
+double Clock::nowMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t Clock::beginWrite()
+{
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    // 序号为奇数表示其他线程正在写, 由偶变奇成功即取得写权
+    while ((seq & 1) || !sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        seq = sequence.load(std::memory_order_relaxed);
+    // 保证读者看到新字段之前先看到奇数序号
+    std::atomic_thread_fence(std::memory_order_release);
+    return seq + 1;
+}
+
+void Clock::endWrite(uint32_t seq)
+{
+    sequence.store(seq + 1, std::memory_order_release);
+}
+
+void Clock::storeFields(double pts_ms, double drift, bool pause)
+{
+    pts.store(pts_ms, std::memory_order_relaxed);
+    ptsDrift.store(drift, std::memory_order_relaxed);
+    paused.store(pause, std::memory_order_relaxed);
+}
+
+void Clock::set(double pts_ms, double time)
+{
+    uint32_t seq = beginWrite();
+    storeFields(pts_ms, pts_ms - time, false);
+    endWrite(seq);
+}
+
+void Clock::setPaused(bool pause)
+{
+    uint32_t seq = beginWrite();
+    // 持有写权期间字段不会被修改, 可直接读取
+    if (paused.load(std::memory_order_relaxed) != pause)
+    {
+        double cur = paused.load(std::memory_order_relaxed) ? pts.load(std::memory_order_relaxed)
+                                                            : ptsDrift.load(std::memory_order_relaxed) + nowMs();
+        if (std::isnan(cur))
+            paused.store(pause, std::memory_order_relaxed);
+        else
+            storeFields(cur, cur - nowMs(), pause);
+    }
+    endWrite(seq);
+}
+
+void Clock::reset()
+{
+    uint32_t seq = beginWrite();
+    storeFields(NAN, NAN, false);
+    endWrite(seq);
+}
+
+Clock::Snapshot Clock::snapshot() const
+{
+    Snapshot snap;
+    uint32_t seq1 = 0;
+    uint32_t seq2 = 0;
+    do
+    {
+        seq1 = sequence.load(std::memory_order_acquire);
+        snap.pts = pts.load(std::memory_order_relaxed);
+        snap.ptsDrift = ptsDrift.load(std::memory_order_relaxed);
+        snap.paused = paused.load(std::memory_order_relaxed);
+        // 保证字段读取先于第二次读取序号
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq2 = sequence.load(std::memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+    return snap;
+}
+
+bool Clock::isValid() const
+{
+    return !std::isnan(snapshot().pts);
+}
+
+double Clock::get() const
+{
+    Snapshot snap = snapshot();
+    if (snap.paused)
+        return snap.pts;
+    return snap.ptsDrift + nowMs();
+}
+
+void MediaClock::reset(bool _hasAudio, bool _hasVideo)
+{
+    hasAudio = _hasAudio;
+    hasVideo = _hasVideo;
+    audioClock.reset();
+    videoClock.reset();
+    externalClock.reset();
+}
+
+MediaClock::SYNC_MASTER MediaClock::getMasterType() const
+{
+    switch (syncMaster.load())
+    {
+    case VIDEO_MASTER:
+        if (hasVideo)
+            return VIDEO_MASTER;
+        return hasAudio ? AUDIO_MASTER : EXTERNAL_MASTER;
+    case AUDIO_MASTER:
+        return hasAudio ? AUDIO_MASTER : EXTERNAL_MASTER;
+    default:
+        return EXTERNAL_MASTER;
+    }
+}
+
+double MediaClock::getMasterClock() const
+{
+    switch (getMasterType())
+    {
+    case AUDIO_MASTER:
+        return audioClock.get();
+    case VIDEO_MASTER:
+        return videoClock.get();
+    default:
+        return externalClock.get();
+    }
+}
+
+void MediaClock::syncExternalToSlave(const Clock &slave)
+{
+    double slaveClock = slave.get();
+    if (std::isnan(slaveClock))
+        return;
+
+    double externalValue = externalClock.get();
+    if (std::isnan(externalValue) || std::fabs(externalValue - slaveClock) > NOSYNC_THRESHOLD_MS)
+        externalClock.set(slaveClock);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// 单个时钟(参考ffplay): 保存pts与设置时刻的差值, 读取时加上当前单调时间即为时钟值
+// 以序号锁(seqlock)保护: 写入前后各将序号加一, 读取时序号为奇数或前后不一致则重读
+// 读取无锁且不阻塞写入, 任意线程可读; 写入之间以序号的偶变奇互斥, 允许多个线程设置同一时钟
+class Clock
+{
+public:
+    struct Snapshot
+    {
+        double pts;      // 最近一次设置的时间戳(ms), 未设置时为NAN
+        double ptsDrift; // pts - 设置时刻(ms)
+        bool paused;
+    };
+
+private:
+    std::atomic<uint32_t> sequence{0};
+    // 字段本身为原子量, 避免读取与写入重叠时的数据竞争, 一致性由序号保证
+    std::atomic<double> pts;
+    std::atomic<double> ptsDrift;
+    std::atomic<bool> paused{false};
+
+    uint32_t beginWrite();
+    void endWrite(uint32_t seq);
+    void storeFields(double pts_ms, double drift, bool pause);
+
+public:
+    Clock() { reset(); }
+
+    // 单调时间(ms), 不受系统时间修改影响
+    static double nowMs();
+
+    // 以pts_ms为time时刻的时钟值, 并恢复走时
+    void set(double pts_ms, double time = nowMs());
+    // 暂停时时钟停在当前值
+    void setPaused(bool pause);
+    void reset();
+
+    // 一次一致的读取
+    Snapshot snapshot() const;
+    bool isValid() const;
+    // 当前时钟值(ms), 未设置时返回NAN
+    double get() const;
+};
+
+// 音视频同步时钟: 音频/视频/外部三个时钟, 可选择其一为主时钟
+class MediaClock
+{
+public:
+    enum SYNC_MASTER
+    {
+        AUDIO_MASTER,    // 视频跟随音频(默认)
+        VIDEO_MASTER,    // 音频通过重采样补偿跟随视频
+        EXTERNAL_MASTER, // 音视频都跟随外部(系统)时钟
+    };
+
+private:
+    Clock audioClock;    // 由音频输出按设备已播放的采样数设置
+    Clock videoClock;    // 由视频同步线程在输出帧时设置
+    Clock externalClock; // 单调系统时钟, 以某一帧/采样的pts为锚点走时
+
+    std::atomic<int> syncMaster{AUDIO_MASTER};
+    std::atomic<bool> hasAudio{false};
+    std::atomic<bool> hasVideo{false};
+
+public:
+    // 打开媒体时调用, 重置所有时钟
+    void reset(bool _hasAudio, bool _hasVideo);
+
+    // 选择主时钟, 对当前媒体立即生效
+    void setSyncMaster(SYNC_MASTER master) { syncMaster = master; }
+    // 实际使用的主时钟: 所选的流不存在时退回音频或外部时钟
+    SYNC_MASTER getMasterType() const;
+    // 主时钟当前值(ms), 未设置时返回NAN
+    double getMasterClock() const;
+
+    // 外部时钟未设置或与slave相差过大时, 以slave为准对齐
+    void syncExternalToSlave(const Clock &slave);
+
+    Clock &audio() { return audioClock; }
+    Clock &video() { return videoClock; }
+    Clock &external() { return externalClock; }
+    const Clock &audio() const { return audioClock; }
+    const Clock &video() const { return videoClock; }
+    const Clock &external() const { return externalClock; }
+};
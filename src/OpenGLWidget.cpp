@@ -1,4 +1,5 @@
 #include "OpenGLWidget.h"
+#include "PipelineStats.h"
 
 #define VERTEXIN 0
 #define TEXTUREIN 1
@@ -68,11 +69,15 @@ void initGLFuncs(QOpenGLFunctions *glFuncs, GLclampf red = 0.0f, GLclampf green
     glFuncs->glClearColor(red, green, blue, alpha);
 }
 
-void loadTexture(QOpenGLFunctions *glFuncs, GLenum textureType, GLuint textureId, GLsizei width, GLsizei height, GLenum format, const GLvoid *pixels)
+// rowLength: 每行像素数(含对齐填充), 用于直接上传带linesize的平面
+void loadTexture(QOpenGLFunctions *glFuncs, GLenum textureType, GLuint textureId, GLsizei width, GLsizei height, GLenum format, const GLvoid *pixels, GLint rowLength)
 {
     glFuncs->glActiveTexture(textureType);
     glFuncs->glBindTexture(GL_TEXTURE_2D, textureId);
+    glFuncs->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glFuncs->glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
     glFuncs->glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    glFuncs->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     glFuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glFuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -99,12 +104,14 @@ void BaseOpenGLWidget::initShader(const void *vertices, int count, const char *f
     program->setAttributeBuffer(TEXTUREIN, GL_FLOAT, 8 * sizeof(GLfloat), 2, 2 * sizeof(GLfloat));
 }
 
-void BaseOpenGLWidget::setPixelData(uint8_t *pixelData, int width, int height)
+void BaseOpenGLWidget::setFrame(AVFrame *frame)
 {
-    if (pixelData == nullptr)
+    if (frame == nullptr)
         return;
 
-    dataPtr.reset(pixelData);
+    framePtr.reset(frame);
+    int width = frame->width;
+    int height = frame->height;
 
     // 长宽比
     videoRatio = (float)width / height;
@@ -145,14 +152,19 @@ void Nv12GLWidget::initializeGL()
 
 void Nv12GLWidget::paintGL()
 {
-    if (dataPtr == nullptr)
+    if (framePtr == nullptr)
         return;
+    StageTimer paintTimer(PipelineStats::STAGE_PAINT);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // 注释后画面卡死
     glDisable(GL_DEPTH_TEST);                           // 关闭深度测试, 注释后内存占用增加
     glViewport(x, y, viewW, viewH);
 
-    loadTexture(this, GL_TEXTURE0, idY, videoW, videoH, GL_RED, dataPtr.get());
-    loadTexture(this, GL_TEXTURE1, idUV, videoW / 2, videoH / 2, GL_RG, dataPtr.get() + videoW * videoH);
+    const AVFrame *frame = framePtr.get();
+    {
+        StageTimer uploadTimer(PipelineStats::STAGE_TEXTURE_UPLOAD, 1, videoW * videoH * 3 / 2);
+        loadTexture(this, GL_TEXTURE0, idY, videoW, videoH, GL_RED, frame->data[0], frame->linesize[0]);
+        loadTexture(this, GL_TEXTURE1, idUV, videoW / 2, videoH / 2, GL_RG, frame->data[1], frame->linesize[1] / 2); // UV交错, 每像素2字节
+    }
 
     glUniform1i(textureUniformY, 0);
     glUniform1i(textureUniformUV, 1);
@@ -181,8 +193,9 @@ void Yuv420GLWidget::initializeGL()
 
 void Yuv420GLWidget::paintGL()
 {
-    if (dataPtr == nullptr)
+    if (framePtr == nullptr)
         return;
+    StageTimer paintTimer(PipelineStats::STAGE_PAINT);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // 注释后画面卡死
     glDisable(GL_DEPTH_TEST);                           // 关闭深度测试, 注释后内存占用增加
     glViewport(x, y, viewW, viewH);
@@ -190,9 +203,13 @@ void Yuv420GLWidget::paintGL()
     int halfW = videoW >> 1;
     int halfH = videoH >> 1;
 
-    loadTexture(this, GL_TEXTURE0, idY, videoW, videoH, GL_RED, dataPtr.get());
-    loadTexture(this, GL_TEXTURE1, idU, halfW, halfH, GL_RED, dataPtr.get() + videoW * videoH);
-    loadTexture(this, GL_TEXTURE2, idV, halfW, halfH, GL_RED, dataPtr.get() + halfW * halfH * 5);
+    const AVFrame *frame = framePtr.get();
+    {
+        StageTimer uploadTimer(PipelineStats::STAGE_TEXTURE_UPLOAD, 1, videoW * videoH + halfW * halfH * 2);
+        loadTexture(this, GL_TEXTURE0, idY, videoW, videoH, GL_RED, frame->data[0], frame->linesize[0]);
+        loadTexture(this, GL_TEXTURE1, idU, halfW, halfH, GL_RED, frame->data[1], frame->linesize[1]);
+        loadTexture(this, GL_TEXTURE2, idV, halfW, halfH, GL_RED, frame->data[2], frame->linesize[2]);
+    }
 
     glUniform1i(textureUniformY, 0);
     glUniform1i(textureUniformU, 1);
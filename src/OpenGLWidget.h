@@ -12,14 +12,25 @@
 #include <QPainter>
 #include <QPixmap>
 
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
 class BaseOpenGLWidget : public QOpenGLWidget
 {
 private:
     QOpenGLBuffer vbo;
     QOpenGLShaderProgram *program{nullptr};
 
+    struct AVFrameDeleter
+    {
+        void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+    };
+
 protected:
-    std::unique_ptr<uint8_t> dataPtr;
+    // 当前帧的引用, 直接按各平面的data/linesize上传纹理, 持有至下一帧到来
+    std::unique_ptr<AVFrame, AVFrameDeleter> framePtr;
     GLsizei videoW, videoH;
     float videoRatio = 1.0f;
 
@@ -34,7 +45,8 @@ protected:
 public:
     BaseOpenGLWidget(QWidget *parent = nullptr) : QOpenGLWidget(parent) {}
 
-    void setPixelData(uint8_t *pixelData, int width, int height);
+    // 取得frame所有权
+    void setFrame(AVFrame *frame);
 };
 
 class Nv12GLWidget : public BaseOpenGLWidget, protected QOpenGLFunctions
@@ -0,0 +1,118 @@
+#include "PacketQueue.h"
+
+void PacketQueue::setTimeBase(double q2d_ms)
+{
+    QMutexLocker locker(&mutex);
+    time_base_q2d_ms = q2d_ms;
+}
+
+void PacketQueue::start()
+{
+    QMutexLocker locker(&mutex);
+    abortRequest = false;
+}
+
+void PacketQueue::abort()
+{
+    QMutexLocker locker(&mutex);
+    abortRequest = true;
+    notEmpty.wakeAll();
+}
+
+void PacketQueue::flush()
+{
+    QMutexLocker locker(&mutex);
+    clear();
+    serial++;
+}
+
+void PacketQueue::clear()
+{
+    while (!queue.isEmpty())
+    {
+        auto node = queue.dequeue();
+        av_packet_free(&node.packet);
+    }
+    bytes = 0;
+    duration = 0;
+}
+
+bool PacketQueue::push(AVPacket *packet)
+{
+    QMutexLocker locker(&mutex);
+    if (abortRequest)
+    {
+        av_packet_free(&packet);
+        return false;
+    }
+
+    queue.enqueue({packet, serial});
+    bytes += packet->size + sizeof(AVPacket);
+    duration += packet->duration;
+    notEmpty.wakeOne();
+    return true;
+}
+
+bool PacketQueue::pushEof(int streamIndex)
+{
+    AVPacket *packet = av_packet_alloc();
+    packet->stream_index = streamIndex;
+    return push(packet);
+}
+
+AVPacket *PacketQueue::pop(int *packetSerial, bool block)
+{
+    AVPacket *packet = nullptr;
+    {
+        QMutexLocker locker(&mutex);
+        while (!abortRequest && queue.isEmpty() && block)
+            notEmpty.wait(&mutex);
+
+        if (abortRequest || queue.isEmpty())
+            return nullptr;
+
+        auto node = queue.dequeue();
+        packet = node.packet;
+        bytes -= packet->size + sizeof(AVPacket);
+        duration -= packet->duration;
+        if (packetSerial)
+            *packetSerial = node.serial;
+    }
+
+    if (consumed)
+    {
+        QMutexLocker consumedLocker(consumedMutex);
+        consumed->wakeAll();
+    }
+    return packet;
+}
+
+bool PacketQueue::isFull() const
+{
+    QMutexLocker locker(&mutex);
+    return bytes >= maxBytes || duration * time_base_q2d_ms >= maxDurationMs;
+}
+
+int PacketQueue::count() const
+{
+    QMutexLocker locker(&mutex);
+    return queue.size();
+}
+
+int64_t PacketQueue::byteSize() const
+{
+    QMutexLocker locker(&mutex);
+    return bytes;
+}
+
+double PacketQueue::durationMs() const
+{
+    QMutexLocker locker(&mutex);
+    return duration * time_base_q2d_ms;
+}
+
+int PacketQueue::getSerial() const
+{
+    QMutexLocker locker(&mutex);
+    return serial;
+}
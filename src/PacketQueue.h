@@ -0,0 +1,72 @@
+#pragma once
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+extern "C"
+{
+#include <libavcodec/packet.h>
+}
+
+// 有界包队列, 同时限制字节数与时长; 由解复用线程写入, 解码线程读取
+// 队列清空(跳转)时serial自增, 解码端据此判断是否需要刷新解码器
+class PacketQueue
+{
+private:
+    struct PacketNode
+    {
+        AVPacket *packet;
+        int serial;
+    };
+
+    QQueue<PacketNode> queue;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QMutex *consumedMutex{nullptr};    // consumed所属的互斥量, 唤醒前加锁, 避免等待方检查条件后、进入等待前的唤醒丢失
+    QWaitCondition *consumed{nullptr}; // 出队时唤醒, 用于通知解复用线程队列有空间
+
+    const int64_t maxBytes;     // 字节数上限
+    const double maxDurationMs; // 时长上限(ms)
+    double time_base_q2d_ms{0.0};
+
+    int64_t bytes{0};    // 队列中包数据总大小
+    int64_t duration{0}; // 队列中包总时长(流时间基)
+    int serial{0};
+    bool abortRequest{true};
+
+    void clear();
+
+public:
+    PacketQueue(int64_t maxBytes, double maxDurationMs) : maxBytes(maxBytes), maxDurationMs(maxDurationMs) {}
+    ~PacketQueue() { clear(); }
+
+    void setConsumedNotifier(QMutex *mutex, QWaitCondition *cond)
+    {
+        consumedMutex = mutex;
+        consumed = cond;
+    }
+    void setTimeBase(double q2d_ms);
+
+    // 允许入队/出队
+    void start();
+    // 中止队列, 唤醒所有阻塞在pop上的线程
+    void abort();
+    // 释放队列中所有包, serial自增
+    void flush();
+
+    // 入队并取得packet所有权, 队列已中止时释放packet并返回false
+    bool push(AVPacket *packet);
+    // 入队一个空包表示流结束, 送入解码器时即为冲刷(drain)信号
+    bool pushEof(int streamIndex);
+    // 出队, block为true时队列为空则阻塞等待; 队列中止或为空(非阻塞)时返回nullptr
+    AVPacket *pop(int *packetSerial = nullptr, bool block = true);
+
+    static bool isEofPacket(const AVPacket *packet) { return packet->data == nullptr && packet->size == 0; }
+
+    // 超出字节或时长上限
+    bool isFull() const;
+    int count() const;
+    int64_t byteSize() const;
+    double durationMs() const;
+    int getSerial() const;
+};
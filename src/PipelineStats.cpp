@@ -0,0 +1,147 @@
+#include "PipelineStats.h"
+#include "MediaClock.h"
+#include "TraceWriter.h"
+#include <QStringList>
+#include <cmath>
+
+PipelineStats *PipelineStats::instance()
+{
+    static PipelineStats *stats = new PipelineStats();
+    return stats;
+}
+
+const char *PipelineStats::stageName(STAGE stage)
+{
+    switch (stage)
+    {
+    case STAGE_DEMUX:
+        return "demux";
+    case STAGE_DEMUX_WAIT:
+        return "demux_wait";
+    case STAGE_AUDIO_PACKET_WAIT:
+        return "audio_packet_wait";
+    case STAGE_AUDIO_DECODE:
+        return "audio_decode";
+    case STAGE_AUDIO_CONVERT:
+        return "audio_convert";
+    case STAGE_AUDIO_WRITE_WAIT:
+        return "audio_write_wait";
+    case STAGE_AUDIO_PULL:
+        return "audio_pull";
+    case STAGE_VIDEO_PACKET_WAIT:
+        return "video_packet_wait";
+    case STAGE_VIDEO_DECODE:
+        return "video_decode";
+    case STAGE_VIDEO_CONVERT:
+        return "video_convert";
+    case STAGE_VIDEO_QUEUE_WAIT:
+        return "video_queue_wait";
+    case STAGE_PRESENT_QUEUE_WAIT:
+        return "present_queue_wait";
+    case STAGE_PRESENT_SYNC_WAIT:
+        return "present_sync_wait";
+    case STAGE_TEXTURE_UPLOAD:
+        return "texture_upload";
+    case STAGE_PAINT:
+        return "paint";
+    case STAGE_SEEK:
+        return "seek";
+    case STAGE_SCRUB:
+        return "scrub";
+    case STAGE_GOP_DECODE:
+        return "gop_decode";
+    default:
+        return "unknown";
+    }
+}
+
+const char *PipelineStats::depthName(DEPTH depth)
+{
+    switch (depth)
+    {
+    case DEPTH_AUDIO_PACKETS_MS:
+        return "audio_packets_ms";
+    case DEPTH_VIDEO_PACKETS_MS:
+        return "video_packets_ms";
+    case DEPTH_VIDEO_FRAMES:
+        return "video_frames";
+    case DEPTH_AUDIO_RING_MS:
+        return "audio_ring_ms";
+    default:
+        return "unknown";
+    }
+}
+
+void PipelineStats::record(STAGE stage, double elapsedMs, int64_t items, int64_t bytes)
+{
+    // 启用时间线记录时每个阶段同时记为一段区间
+    if (TraceWriter::isEnabled())
+        TraceWriter::complete(stageName(stage), Clock::nowMs() - elapsedMs, elapsedMs);
+
+    Stage &s = stages[stage];
+    s.latencyUs.record(std::llround(elapsedMs * 1000.0));
+    s.items.fetch_add(items, std::memory_order_relaxed);
+    s.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void PipelineStats::beginSeek(double startMs, int serial, STAGE stage)
+{
+    seekSerial.store(serial, std::memory_order_relaxed);
+    seekStage.store(stage, std::memory_order_relaxed);
+    seekStartMs.store(startMs, std::memory_order_release);
+}
+
+void PipelineStats::endSeek(int serial)
+{
+    // 每显示一帧调用一次, 无进行中的跳转时只有一次原子读取
+    double startMs = seekStartMs.load(std::memory_order_acquire);
+    if (std::isnan(startMs) || serial < seekSerial.load(std::memory_order_relaxed))
+        return;
+    if (seekStartMs.compare_exchange_strong(startMs, NAN, std::memory_order_relaxed))
+        record(static_cast<STAGE>(seekStage.load(std::memory_order_relaxed)), Clock::nowMs() - startMs);
+}
+
+void PipelineStats::reset()
+{
+    for (Stage &s : stages)
+    {
+        s.latencyUs.reset();
+        s.items.store(0, std::memory_order_relaxed);
+        s.bytes.store(0, std::memory_order_relaxed);
+    }
+    for (Histogram &depth : depths)
+        depth.reset();
+    seekStartMs.store(NAN, std::memory_order_relaxed);
+}
+
+double PipelineStats::getBusyMs(STAGE stage) const
+{
+    const Histogram &latency = stages[stage].latencyUs;
+    return latency.mean() * latency.count() / 1000.0;
+}
+
+QString PipelineStats::summary() const
+{
+    QStringList lines;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        if (stages[i].latencyUs.count() > 0)
+            lines << QString("%1(us): %2").arg(stageName(static_cast<STAGE>(i)), stages[i].latencyUs.summary());
+    }
+    for (int i = 0; i < DEPTH_COUNT; i++)
+    {
+        if (depths[i].count() > 0)
+            lines << QString("%1: %2").arg(depthName(static_cast<DEPTH>(i)), depths[i].summary());
+    }
+    return lines.join('\n');
+}
+
+StageTimer::StageTimer(PipelineStats::STAGE stage, int64_t items, int64_t bytes)
+    : stage(stage), startMs(Clock::nowMs()), items(items), bytes(bytes)
+{
+}
+
+StageTimer::~StageTimer()
+{
+    PipelineStats::instance()->record(stage, Clock::nowMs() - startMs, items, bytes);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "Histogram.h"
+#include <QString>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// 流水线各阶段耗时与队列深度统计, 进程级, 常开
+// 各线程无锁记录, 任意线程随时查询; 卡顿时对比各阶段的耗时分位数与队列深度即可定位是哪一级跟不上
+class PipelineStats
+{
+public:
+    // 每次记录一个阶段的一次处理: 耗时计入直方图(us), 同时累计处理的条目数(包/帧)与字节数
+    enum STAGE
+    {
+        STAGE_DEMUX,               // 读取一个包(av_read_frame)
+        STAGE_DEMUX_WAIT,          // 解复用因包队列已满挂起
+        STAGE_AUDIO_PACKET_WAIT,   // 音频解码等待包队列
+        STAGE_AUDIO_DECODE,        // 送入一个音频包并取出其解出的帧
+        STAGE_AUDIO_CONVERT,       // 重采样一帧
+        STAGE_AUDIO_WRITE_WAIT,    // 音频解码等待环形缓冲可写(背压)
+        STAGE_AUDIO_PULL,          // 音频设备取一次数据
+        STAGE_VIDEO_PACKET_WAIT,   // 视频解码等待包队列
+        STAGE_VIDEO_DECODE,        // 送入一个视频包并取出其解出的帧
+        STAGE_VIDEO_CONVERT,       // 硬件帧下载与像素格式转换一帧
+        STAGE_VIDEO_QUEUE_WAIT,    // 视频解码等待帧队列有空位(背压)
+        STAGE_PRESENT_QUEUE_WAIT,  // 视频输出等待帧队列有帧
+        STAGE_PRESENT_SYNC_WAIT,   // 视频输出等待时钟到达帧的时间戳
+        STAGE_TEXTURE_UPLOAD,      // 上传一帧的各平面纹理
+        STAGE_PAINT,               // 绘制一帧(含纹理上传)
+        STAGE_SEEK,                // 从投递跳转命令到跳转后第一帧显示
+        STAGE_SCRUB,               // 拖动预览: 从投递预览命令到预览帧显示
+        STAGE_GOP_DECODE,          // 逐帧后退/倒放时解码一段GOP存入缓存
+        STAGE_COUNT,
+    };
+
+    // 队列深度, 由消费方在取数据时采样
+    enum DEPTH
+    {
+        DEPTH_AUDIO_PACKETS_MS, // 音频包队列缓存时长
+        DEPTH_VIDEO_PACKETS_MS, // 视频包队列缓存时长
+        DEPTH_VIDEO_FRAMES,     // 解码帧队列帧数
+        DEPTH_AUDIO_RING_MS,    // PCM环形缓冲缓存时长
+        DEPTH_COUNT,
+    };
+
+private:
+    struct Stage
+    {
+        Histogram latencyUs;
+        std::atomic<int64_t> items{0};
+        std::atomic<int64_t> bytes{0};
+    };
+
+    Stage stages[STAGE_COUNT];
+    Histogram depths[DEPTH_COUNT];
+
+    // 进行中的跳转: 命令投递时间与跳转后帧的最小serial
+    std::atomic<double> seekStartMs{NAN};
+    std::atomic<int> seekSerial{0};
+    std::atomic<int> seekStage{STAGE_SEEK}; // 完成时记入的阶段: STAGE_SEEK或STAGE_SCRUB
+
+    PipelineStats() = default;
+
+public:
+    PipelineStats(const PipelineStats &) = delete;
+    PipelineStats &operator=(const PipelineStats &) = delete;
+
+    static PipelineStats *instance();
+    static const char *stageName(STAGE stage);
+    static const char *depthName(DEPTH depth);
+
+    void record(STAGE stage, double elapsedMs, int64_t items = 1, int64_t bytes = 0);
+    void recordDepth(DEPTH depth, int64_t value) { depths[depth].record(value); }
+    // 跳转开始, serial为跳转后视频帧的最小serial; 取代尚未完成的跳转
+    void beginSeek(double startMs, int serial, STAGE stage = STAGE_SEEK);
+    // 显示了一帧, 是跳转后的第一帧时记录beginSeek指定的阶段
+    void endSeek(int serial);
+    void reset();
+
+    const Histogram &getLatency(STAGE stage) const { return stages[stage].latencyUs; }
+    int64_t getItems(STAGE stage) const { return stages[stage].items.load(std::memory_order_relaxed); }
+    int64_t getBytes(STAGE stage) const { return stages[stage].bytes.load(std::memory_order_relaxed); }
+    // 该阶段累计耗时(ms)
+    double getBusyMs(STAGE stage) const;
+    const Histogram &getDepth(DEPTH depth) const { return depths[depth]; }
+
+    // 所有有记录的阶段与队列深度, 每项一行, 用于日志
+    QString summary() const;
+};
+
+// 作用域计时, 析构时向PipelineStats记录一次
+class StageTimer
+{
+private:
+    PipelineStats::STAGE stage;
+    double startMs;
+    int64_t items;
+    int64_t bytes;
+
+public:
+    explicit StageTimer(PipelineStats::STAGE stage, int64_t items = 1, int64_t bytes = 0);
+    ~StageTimer();
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    void setBytes(int64_t value) { bytes = value; }
+};
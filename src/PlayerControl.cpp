@@ -0,0 +1,108 @@
+#include "PlayerControl.h"
+#include "MediaClock.h"
+
+uint64_t PlayerControl::post(PLAYER_COMMAND type, int64_t arg)
+{
+    uint64_t w = writePos.load(std::memory_order_relaxed);
+    uint64_t r = readPos.load(std::memory_order_acquire);
+    if (w - r >= COMMAND_QUEUE_SIZE)
+        return 0;
+
+    PlayerCommand &command = commands[w & (COMMAND_QUEUE_SIZE - 1)];
+    command.type = type;
+    command.arg = arg;
+    command.id = nextId++;
+    command.postTimeMs = Clock::nowMs();
+
+    writePos.store(w + 1, std::memory_order_release);
+    return command.id;
+}
+
+void PlayerControl::setState(CONTL_TYPE newState)
+{
+    {
+        QMutexLocker locker(&stateMutex);
+        state.store(newState, std::memory_order_release);
+    }
+    stateChanged.wakeAll();
+}
+
+void PlayerControl::setReverse(bool enable)
+{
+    {
+        QMutexLocker locker(&stateMutex);
+        reverse.store(enable, std::memory_order_release);
+    }
+    stateChanged.wakeAll();
+}
+
+bool PlayerControl::waitWhileState(CONTL_TYPE curState, unsigned long timeoutMs) const
+{
+    QMutexLocker locker(&stateMutex);
+    if (getState() == curState)
+        stateChanged.wait(&stateMutex, timeoutMs);
+    return getState() == curState;
+}
+
+void PlayerControl::stop()
+{
+    stopBarrier.store(nextId, std::memory_order_release);
+    reverse.store(false, std::memory_order_release);
+    setState(CONTL_TYPE::STOP);
+}
+
+bool PlayerControl::take(PlayerCommand *command)
+{
+    while (true)
+    {
+        uint64_t r = readPos.load(std::memory_order_relaxed);
+        uint64_t w = writePos.load(std::memory_order_acquire);
+        if (r == w)
+            return false;
+
+        *command = commands[r & (COMMAND_QUEUE_SIZE - 1)];
+        readPos.store(r + 1, std::memory_order_release);
+
+        if (command->id >= stopBarrier.load(std::memory_order_acquire))
+            return true;
+        ackedId.store(command->id, std::memory_order_release); // 已被stop()取消
+    }
+}
+
+double PlayerControl::acknowledge(const PlayerCommand &command)
+{
+    double latency = Clock::nowMs() - command.postTimeMs;
+    if (command.type == CMD_PLAY)
+        lastPlayTimeMs.store(command.postTimeMs, std::memory_order_relaxed);
+    lastLatencyMs.store(latency, std::memory_order_relaxed);
+    if (latency > maxLatencyMs.load(std::memory_order_relaxed))
+        maxLatencyMs.store(latency, std::memory_order_relaxed);
+
+    ackedId.store(command.id, std::memory_order_release);
+    return latency;
+}
+
+const char *playerCommandName(PLAYER_COMMAND type)
+{
+    switch (type)
+    {
+    case CMD_PLAY:
+        return "PLAY";
+    case CMD_PAUSE:
+        return "PAUSE";
+    case CMD_SEEK:
+        return "SEEK";
+    case CMD_STOP:
+        return "STOP";
+    case CMD_STEP:
+        return "STEP";
+    case CMD_SCRUB:
+        return "SCRUB";
+    case CMD_STEP_BACK:
+        return "STEP_BACK";
+    case CMD_REVERSE:
+        return "REVERSE";
+    default:
+        return "UNKNOWN";
+    }
+}
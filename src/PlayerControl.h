@@ -0,0 +1,87 @@
+#pragma once
+#include "playerCommand.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 播放控制命令
+enum PLAYER_COMMAND
+{
+    CMD_PLAY,
+    CMD_PAUSE,
+    CMD_SEEK, // arg为目标时间戳(ms)
+    CMD_STOP,
+    CMD_STEP, // 暂停时前进一帧
+    CMD_SCRUB, // 暂停时拖动预览, arg为目标时间戳(ms); 只显示目标之前最近的关键帧, 连续的预览命令只执行最后一条
+    CMD_STEP_BACK, // 暂停时后退一帧
+    CMD_REVERSE,   // 开始/结束倒放, 播放中投递时先暂停; 其他任何命令都会结束倒放
+};
+
+struct PlayerCommand
+{
+    PLAYER_COMMAND type;
+    int64_t arg;
+    uint64_t id;       // 从1开始递增
+    double postTimeMs; // 投递时的单调时间(ms)
+};
+
+// 播放控制: 原子播放状态 + 无锁命令队列
+// 界面线程投递命令(单生产者), 解码协调线程取出并执行(单消费者), 执行后确认并记录命令从投递到生效的延迟
+// 各工作线程每处理一个包/帧读取一次状态, 暂停/停止在一个包内生效, 无需等待固定时长
+// 需要定时等待的线程挂起在状态条件变量上, 状态变化时立即唤醒
+class PlayerControl
+{
+private:
+    static const size_t COMMAND_QUEUE_SIZE = 64; // 必须为2的幂
+
+    PlayerCommand commands[COMMAND_QUEUE_SIZE];
+    std::atomic<uint64_t> writePos{0};
+    std::atomic<uint64_t> readPos{0};
+
+    std::atomic<int> state{CONTL_TYPE::NONE};
+    std::atomic<bool> reverse{false}; // 倒放, 只在PAUSE状态下有意义
+    mutable QMutex stateMutex; // 状态在此锁内修改, 保证等待方不丢失唤醒; 读取状态无需加锁
+    mutable QWaitCondition stateChanged;
+
+    uint64_t nextId{1};                   // 仅生产者访问
+    std::atomic<uint64_t> stopBarrier{0}; // id小于此值的命令在stop()之前投递, 取出时丢弃
+    std::atomic<uint64_t> ackedId{0};     // 最近已执行(或已丢弃)的命令id
+
+    std::atomic<double> lastLatencyMs{0.0};
+    std::atomic<double> maxLatencyMs{0.0};
+    std::atomic<double> lastPlayTimeMs{0.0}; // 最近一次播放命令的投递时间, 用于统计恢复到首帧的延迟
+
+public:
+    PlayerControl() = default;
+    PlayerControl(const PlayerControl &) = delete;
+    PlayerControl &operator=(const PlayerControl &) = delete;
+
+    CONTL_TYPE getState() const { return static_cast<CONTL_TYPE>(state.load(std::memory_order_acquire)); }
+    // 直接切换状态, 用于命令执行方, 以及播放结束等由流水线自身触发的状态变化
+    void setState(CONTL_TYPE newState);
+    // 状态为curState时挂起至多timeoutMs毫秒, 状态变化时立即返回; 返回时状态是否仍为curState
+    bool waitWhileState(CONTL_TYPE curState, unsigned long timeoutMs) const;
+    // 开始/结束倒放, 同样唤醒挂起在状态条件变量上的线程
+    void setReverse(bool enable);
+    bool isReverse() const { return reverse.load(std::memory_order_acquire); }
+
+    // 生产者: 投递命令, 返回命令id, 队列满时返回0
+    uint64_t post(PLAYER_COMMAND type, int64_t arg = 0);
+    // 生产者: 立即进入STOP并丢弃尚未执行的命令, 切换媒体/关闭时使用, 不依赖执行线程
+    void stop();
+
+    // 消费者: 取出一条待执行的命令, 无命令时返回false; stop()之前投递的命令被跳过
+    bool take(PlayerCommand *command);
+    // 消费者: 命令已生效, 返回从投递到生效的延迟(ms)
+    double acknowledge(const PlayerCommand &command);
+
+    // 命令是否已执行(或因stop()被丢弃)
+    bool isApplied(uint64_t id) const { return ackedId.load(std::memory_order_acquire) >= id; }
+    double getLastLatencyMs() const { return lastLatencyMs.load(std::memory_order_relaxed); }
+    double getMaxLatencyMs() const { return maxLatencyMs.load(std::memory_order_relaxed); }
+    double getLastPlayTimeMs() const { return lastPlayTimeMs.load(std::memory_order_relaxed); }
+};
+
+const char *playerCommandName(PLAYER_COMMAND type);
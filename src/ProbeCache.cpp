@@ -0,0 +1,243 @@
+#include "ProbeCache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#define PROBE_CACHE_VERSION 1        // 缓存内容变化时递增, 旧版本条目视为未命中
+#define MAX_PROBE_CACHE_ENTRIES 256 // 条目上限, 每个条目为一个约1KB的小文件
+
+QString ProbeCache::fileKey(const QString &filePath)
+{
+    QFileInfo info(filePath);
+    if (!info.exists() || !info.isFile())
+        return QString();
+
+    QString key = QString("%1|%2|%3").arg(info.absoluteFilePath()).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+    return QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString ProbeCache::entryPath(const QString &filePath)
+{
+    QString key = fileKey(filePath);
+    if (key.isEmpty())
+        return QString();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/probe/" + key + ".json";
+}
+
+bool ProbeCache::load(const QString &filePath, Entry *entry)
+{
+    QString path = entryPath(filePath);
+    if (path.isEmpty())
+        return false;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonObject obj = QJsonDocument::fromJson(file.readAll()).object();
+    if (obj["version"].toInt() != PROBE_CACHE_VERSION)
+        return false;
+
+    // 64位整数以字符串保存, 避免经double转换丢失精度
+    entry->durationUs = obj["duration"].toString().toLongLong();
+    entry->startTimeUs = obj["start_time"].toString().toLongLong();
+    entry->bitRate = obj["bit_rate"].toString().toLongLong();
+    entry->streams.clear();
+    for (const QJsonValue &value : obj["streams"].toArray())
+    {
+        QJsonObject s = value.toObject();
+        StreamInfo stream;
+        stream.codecType = s["codec_type"].toInt();
+        stream.codecId = s["codec_id"].toInt();
+        stream.format = s["format"].toInt();
+        stream.width = s["width"].toInt();
+        stream.height = s["height"].toInt();
+        stream.sarNum = s["sar_num"].toInt();
+        stream.sarDen = s["sar_den"].toInt();
+        stream.sampleRate = s["sample_rate"].toInt();
+        stream.channels = s["channels"].toInt();
+        stream.bitRate = s["bit_rate"].toString().toLongLong();
+        stream.profile = s["profile"].toInt();
+        stream.level = s["level"].toInt();
+        stream.frameRateNum = s["frame_rate_num"].toInt();
+        stream.frameRateDen = s["frame_rate_den"].toInt();
+        stream.duration = s["duration"].toString().toLongLong();
+        stream.startTime = s["start_time"].toString().toLongLong();
+        entry->streams.append(stream);
+    }
+    return !entry->streams.isEmpty();
+}
+
+void ProbeCache::store(const QString &filePath, const Entry &entry)
+{
+    QString path = entryPath(filePath);
+    if (path.isEmpty())
+        return;
+
+    QJsonArray streams;
+    for (const StreamInfo &stream : entry.streams)
+    {
+        QJsonObject s;
+        s["codec_type"] = stream.codecType;
+        s["codec_id"] = stream.codecId;
+        s["format"] = stream.format;
+        s["width"] = stream.width;
+        s["height"] = stream.height;
+        s["sar_num"] = stream.sarNum;
+        s["sar_den"] = stream.sarDen;
+        s["sample_rate"] = stream.sampleRate;
+        s["channels"] = stream.channels;
+        s["bit_rate"] = QString::number(stream.bitRate);
+        s["profile"] = stream.profile;
+        s["level"] = stream.level;
+        s["frame_rate_num"] = stream.frameRateNum;
+        s["frame_rate_den"] = stream.frameRateDen;
+        s["duration"] = QString::number(stream.duration);
+        s["start_time"] = QString::number(stream.startTime);
+        streams.append(s);
+    }
+    QJsonObject obj;
+    obj["version"] = PROBE_CACHE_VERSION;
+    obj["file"] = QFileInfo(filePath).absoluteFilePath();
+    obj["duration"] = QString::number(entry.durationUs);
+    obj["start_time"] = QString::number(entry.startTimeUs);
+    obj["bit_rate"] = QString::number(entry.bitRate);
+    obj["streams"] = streams;
+
+    QDir dir = QFileInfo(path).absoluteDir();
+    if (!dir.exists() && !dir.mkpath("."))
+        return;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "probe cache write failed:" << path;
+        return;
+    }
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    file.close();
+
+    QFileInfoList entries = dir.entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Time); // 最新的在前
+    for (int i = MAX_PROBE_CACHE_ENTRIES; i < entries.size(); i++)
+        QFile::remove(entries[i].absoluteFilePath());
+}
+
+ProbeCache::Entry ProbeCache::fromFormatContext(const AVFormatContext *formatContext)
+{
+    Entry entry;
+    entry.durationUs = formatContext->duration;
+    entry.startTimeUs = formatContext->start_time;
+    entry.bitRate = formatContext->bit_rate;
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        const AVStream *st = formatContext->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        StreamInfo stream;
+        stream.codecType = par->codec_type;
+        stream.codecId = par->codec_id;
+        stream.format = par->format;
+        stream.width = par->width;
+        stream.height = par->height;
+        stream.sarNum = par->sample_aspect_ratio.num;
+        stream.sarDen = par->sample_aspect_ratio.den;
+        stream.sampleRate = par->sample_rate;
+        stream.channels = par->ch_layout.nb_channels;
+        stream.bitRate = par->bit_rate;
+        stream.profile = par->profile;
+        stream.level = par->level;
+        stream.frameRateNum = st->avg_frame_rate.num;
+        stream.frameRateDen = st->avg_frame_rate.den;
+        stream.duration = st->duration;
+        stream.startTime = st->start_time;
+        entry.streams.append(stream);
+    }
+    return entry;
+}
+
+bool ProbeCache::apply(const Entry &entry, AVFormatContext *formatContext)
+{
+    // 先整体校验, 不一致时不做任何修改
+    if (formatContext->nb_streams != static_cast<unsigned int>(entry.streams.size()))
+        return false;
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        const AVCodecParameters *par = formatContext->streams[i]->codecpar;
+        if (par->codec_type != entry.streams[i].codecType || par->codec_id != entry.streams[i].codecId)
+            return false;
+    }
+
+    // 只补全文件头中缺失的参数, 已有的以文件为准
+    if (formatContext->duration == AV_NOPTS_VALUE)
+        formatContext->duration = entry.durationUs;
+    if (formatContext->start_time == AV_NOPTS_VALUE)
+        formatContext->start_time = entry.startTimeUs;
+    if (formatContext->bit_rate <= 0)
+        formatContext->bit_rate = entry.bitRate;
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        AVStream *st = formatContext->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        const StreamInfo &stream = entry.streams[i];
+        if (par->format < 0)
+            par->format = stream.format;
+        if (par->width <= 0 || par->height <= 0)
+        {
+            par->width = stream.width;
+            par->height = stream.height;
+        }
+        if (par->sample_aspect_ratio.num == 0)
+            par->sample_aspect_ratio = AVRational{stream.sarNum, stream.sarDen};
+        if (par->sample_rate <= 0)
+            par->sample_rate = stream.sampleRate;
+        if (par->ch_layout.nb_channels <= 0 && stream.channels > 0)
+        {
+            av_channel_layout_uninit(&par->ch_layout);
+            av_channel_layout_default(&par->ch_layout, stream.channels);
+        }
+        if (par->bit_rate <= 0)
+            par->bit_rate = stream.bitRate;
+        if (par->profile < 0)
+            par->profile = stream.profile;
+        if (par->level < 0)
+            par->level = stream.level;
+        if (st->avg_frame_rate.num == 0 && stream.frameRateDen > 0)
+            st->avg_frame_rate = AVRational{stream.frameRateNum, stream.frameRateDen};
+        if (st->duration == AV_NOPTS_VALUE)
+            st->duration = stream.duration;
+        if (st->start_time == AV_NOPTS_VALUE)
+            st->start_time = stream.startTime;
+    }
+    return true;
+}
+
+bool ProbeCache::isComplete(const AVFormatContext *formatContext)
+{
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+    {
+        const AVCodecParameters *par = formatContext->streams[i]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            // 封面图等附加图片不参与播放, 不要求参数齐全
+            if (formatContext->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)
+                continue;
+            if (par->codec_id == AV_CODEC_ID_NONE || par->width <= 0 || par->height <= 0 || par->format < 0)
+                return false;
+        }
+        else if (par->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            if (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0 || par->format < 0)
+                return false;
+        }
+    }
+    return formatContext->nb_streams > 0;
+}
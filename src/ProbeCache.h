@@ -0,0 +1,61 @@
+#pragma once
+#include <QString>
+#include <QVector>
+#include <cstdint>
+
+struct AVFormatContext;
+
+// 流探测结果的磁盘缓存, 以文件路径/大小/修改时间为键
+// 再次打开已知文件时, 用缓存补全avformat_open_input未能从文件头得到的参数, 无需avformat_find_stream_info
+// 只缓存本地文件; 缓存与实际流不一致(流数量/类型/编码不同)时视为未命中
+class ProbeCache
+{
+public:
+    struct StreamInfo
+    {
+        int codecType;
+        int codecId;
+        int format; // 像素格式或采样格式
+        int width;
+        int height;
+        int sarNum;
+        int sarDen;
+        int sampleRate;
+        int channels;
+        int64_t bitRate;
+        int profile;
+        int level;
+        int frameRateNum; // avg_frame_rate
+        int frameRateDen;
+        int64_t duration; // 流时间基下的时长
+        int64_t startTime;
+    };
+
+    struct Entry
+    {
+        int64_t durationUs;
+        int64_t startTimeUs;
+        int64_t bitRate;
+        QVector<StreamInfo> streams;
+    };
+
+private:
+    // 缓存文件路径, 无法取得文件大小/修改时间(不存在或非本地文件)时返回空
+    static QString entryPath(const QString &filePath);
+
+public:
+    // 本地文件的缓存键(路径/大小/修改时间的哈希), 非本地文件返回空; 其他按文件缓存的数据共用此键
+    static QString fileKey(const QString &filePath);
+
+    // 读取缓存, 未命中返回false
+    static bool load(const QString &filePath, Entry *entry);
+    // 写入缓存, 条目过多时删除最久未更新的条目
+    static void store(const QString &filePath, const Entry &entry);
+
+    // 从探测完成的formatContext提取缓存内容
+    static Entry fromFormatContext(const AVFormatContext *formatContext);
+    // 用缓存补全formatContext中缺失的参数, 流不一致时返回false且不修改
+    static bool apply(const Entry &entry, AVFormatContext *formatContext);
+    // 各音频/视频流的解码参数是否齐全, 齐全时可直接打开解码器
+    static bool isComplete(const AVFormatContext *formatContext);
+};
@@ -0,0 +1,342 @@
+#include "ThumbnailCache.h"
+#include "MediaClock.h"
+#include "ProbeCache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#define THUMBNAIL_WIDTH 160             // 缩略图宽度, 高度按画面宽高比
+#define THUMBNAIL_MIN_INTERVAL_MS 2000  // 短片也不超过每2秒一张
+#define MAX_THUMBNAILS 300              // 长片按此张数均分
+#define THUMBNAIL_CACHE_KB (16 * 1024)  // 内存缓存的初始容量, 插入时扩大到能容纳整套缩略图(300张16:9约17MB, 与生成时的sprite相当)
+#define THUMBNAIL_DECODE_THREADS 2      // 后台解码线程数, 不与播放争抢CPU
+#define SPRITE_COLUMNS 10               // sprite每行缩略图数
+#define SPRITE_QUALITY 80               // sprite的JPEG质量
+#define MAX_SPRITE_FILES 64             // sprite文件上限, 超出时删除最久未更新的
+
+ThumbnailCache::ThumbnailCache() : images(THUMBNAIL_CACHE_KB) {}
+
+int64_t ThumbnailCache::intervalFor(int64_t durationMs)
+{
+    if (durationMs <= 0)
+        return 0;
+    return std::max<int64_t>(THUMBNAIL_MIN_INTERVAL_MS, (durationMs + MAX_THUMBNAILS - 1) / MAX_THUMBNAILS);
+}
+
+int ThumbnailCache::countFor(int64_t durationMs)
+{
+    int64_t interval = intervalFor(durationMs);
+    if (interval == 0)
+        return 0;
+    return static_cast<int>((durationMs + interval - 1) / interval);
+}
+
+QString ThumbnailCache::spritePath(const QString &mediaPath)
+{
+    QString key = ProbeCache::fileKey(mediaPath);
+    if (key.isEmpty())
+        return QString();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails/" + key + ".jpg";
+}
+
+QString ThumbnailCache::failedListPath(const QString &mediaPath)
+{
+    QString path = spritePath(mediaPath);
+    if (path.isEmpty())
+        return QString();
+    return path.left(path.size() - 4) + ".failed";
+}
+
+void ThumbnailCache::reset(const QString &_mediaPath, int64_t durationMs)
+{
+    QMutexLocker locker(&mutex);
+    images.clear();
+    images.setMaxCost(THUMBNAIL_CACHE_KB);
+    mediaPath = _mediaPath;
+    intervalMs = intervalFor(durationMs);
+    count = countFor(durationMs);
+}
+
+void ThumbnailCache::insert(const QString &_mediaPath, int index, const QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    if (_mediaPath != mediaPath || index < 0 || index >= count)
+        return; // 已切换媒体
+    // 同一媒体的缩略图尺寸相同, 容量按整套计算, 悬停时不会淘汰后再从sprite重新解码
+    int cost = std::max<int>(1, static_cast<int>(image.sizeInBytes() / 1024));
+    if (images.maxCost() < cost * count)
+        images.setMaxCost(cost * count);
+    images.insert(index, new QImage(image), cost);
+}
+
+bool ThumbnailCache::find(int64_t pts_ms, QImage *image, int *index) const
+{
+    QMutexLocker locker(&mutex);
+    if (count == 0)
+        return false;
+
+    // 取最近的取样点
+    int i = static_cast<int>(std::min<int64_t>(std::max<int64_t>((pts_ms + intervalMs / 2) / intervalMs, 0), count - 1));
+    if (index)
+        *index = i;
+    const QImage *cached = images.object(i);
+    if (cached == nullptr)
+        return false;
+    *image = *cached; // 隐式共享, 不拷贝像素
+    return true;
+}
+
+QString ThumbnailCache::getMediaPath() const
+{
+    QMutexLocker locker(&mutex);
+    return mediaPath;
+}
+
+int ThumbnailCache::getCount() const
+{
+    QMutexLocker locker(&mutex);
+    return count;
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+    sws_freeContext(swsContext);
+}
+
+int ThumbnailGenerator::interruptCallback(void *opaque)
+{
+    // opaque指向本次生成的序号, 与当前序号不同说明已被取消
+    const std::pair<ThumbnailGenerator *, int> *request = static_cast<const std::pair<ThumbnailGenerator *, int> *>(opaque);
+    return request->first->currentSerial != request->second ? 1 : 0;
+}
+
+void ThumbnailGenerator::generate(const QString &mediaPath, qint64 durationMs, int serial)
+{
+    if (serial != currentSerial)
+        return;
+    if (loadSprite(mediaPath))
+        return;
+    decodeAll(mediaPath, durationMs, serial);
+}
+
+void ThumbnailGenerator::reload(const QString &mediaPath, int index, int serial)
+{
+    if (serial != currentSerial)
+        return;
+    loadSprite(mediaPath, index);
+}
+
+bool ThumbnailGenerator::loadSprite(const QString &mediaPath, int index)
+{
+    QString path = ThumbnailCache::spritePath(mediaPath);
+    if (path.isEmpty())
+        return false;
+    QImage sprite(path);
+    int count = cache->getCount();
+    int rows = (count + SPRITE_COLUMNS - 1) / SPRITE_COLUMNS;
+    if (sprite.isNull() || rows == 0 || sprite.width() != SPRITE_COLUMNS * THUMBNAIL_WIDTH || sprite.height() % rows != 0)
+        return false;
+    if (sprite.format() != QImage::Format_RGB32)
+        sprite = sprite.convertToFormat(QImage::Format_RGB32);
+
+    // 生成失败的缩略图在sprite中为空白, 不作为预览
+    QSet<int> failed;
+    QFile failedList(ThumbnailCache::failedListPath(mediaPath));
+    if (failedList.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        while (!failedList.atEnd())
+        {
+            bool ok = false;
+            int i = failedList.readLine().trimmed().toInt(&ok);
+            if (ok)
+                failed.insert(i);
+        }
+    }
+
+    int height = sprite.height() / rows;
+    for (int i = 0; i < count; i++)
+    {
+        if ((index >= 0 && i != index) || failed.contains(i))
+            continue;
+        cache->insert(mediaPath, i, sprite.copy(i % SPRITE_COLUMNS * THUMBNAIL_WIDTH, i / SPRITE_COLUMNS * height, THUMBNAIL_WIDTH, height));
+        emit thumbnailReady(i);
+    }
+    return true;
+}
+
+void ThumbnailGenerator::decodeAll(const QString &mediaPath, int64_t durationMs, int serial)
+{
+    double start = Clock::nowMs();
+    std::pair<ThumbnailGenerator *, int> request(this, serial);
+    AVFormatContext *formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = &request;
+    if (avformat_open_input(&formatContext, mediaPath.toUtf8().constData(), nullptr, nullptr) != 0)
+        return;
+
+    // 播放器打开时已写入探测缓存, 命中时无需再次探测
+    ProbeCache::Entry entry;
+    bool probed = ProbeCache::load(mediaPath, &entry) && ProbeCache::apply(entry, formatContext) && ProbeCache::isComplete(formatContext);
+    const AVCodec *codec = nullptr;
+    int streamIndex = -1;
+    if (probed || avformat_find_stream_info(formatContext, nullptr) >= 0)
+        streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (streamIndex < 0 || (formatContext->streams[streamIndex]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+    {
+        avformat_close_input(&formatContext);
+        return;
+    }
+
+    // 只读视频流, 其余流的包由解复用器直接丢弃
+    for (unsigned int i = 0; i < formatContext->nb_streams; i++)
+        formatContext->streams[i]->discard = static_cast<int>(i) == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    AVStream *stream = formatContext->streams[streamIndex];
+
+    // 只解码关键帧, 画质要求低, 省去环路滤波
+    AVCodecContext *codecContext = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecContext, stream->codecpar);
+    codecContext->thread_count = THUMBNAIL_DECODE_THREADS;
+    codecContext->skip_frame = AVDISCARD_NONKEY;
+    codecContext->skip_loop_filter = AVDISCARD_ALL;
+    if (avcodec_open2(codecContext, codec, nullptr) < 0)
+    {
+        avcodec_free_context(&codecContext);
+        avformat_close_input(&formatContext);
+        return;
+    }
+
+    int64_t interval = ThumbnailCache::intervalFor(durationMs);
+    int count = ThumbnailCache::countFor(durationMs);
+    int64_t startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    QImage sprite;
+    int height = 0;
+    int generated = 0;
+    QVector<int> failed; // 生成失败的序号, 在sprite中留空
+    AVFrame *frame = av_frame_alloc();
+    for (int i = 0; i < count && serial == currentSerial; i++)
+    {
+        int64_t timestamp = startTime + av_rescale_q(i * interval, AVRational{1, 1000}, stream->time_base);
+        if (av_seek_frame(formatContext, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0 ||
+            !decodeKeyframe(formatContext, codecContext, streamIndex, frame, serial))
+        {
+            failed.append(i);
+            continue;
+        }
+
+        if (sprite.isNull())
+        { // 按第一帧的显示宽高比确定缩略图高度, 之后各帧缩放到同一尺寸
+            AVRational sar = frame->sample_aspect_ratio.num > 0 ? frame->sample_aspect_ratio : AVRational{1, 1};
+            double displayWidth = frame->width * av_q2d(sar);
+            height = std::max(2, static_cast<int>(THUMBNAIL_WIDTH * frame->height / displayWidth) & ~1);
+            sprite = QImage(SPRITE_COLUMNS * THUMBNAIL_WIDTH, (count + SPRITE_COLUMNS - 1) / SPRITE_COLUMNS * height, QImage::Format_RGB32);
+            sprite.fill(Qt::black);
+        }
+        QImage image = scaleFrame(frame, height);
+        av_frame_unref(frame);
+        if (image.isNull())
+        {
+            failed.append(i);
+            continue;
+        }
+
+        for (int y = 0; y < height; y++)
+            std::memcpy(sprite.scanLine(i / SPRITE_COLUMNS * height + y) + i % SPRITE_COLUMNS * THUMBNAIL_WIDTH * 4, image.constScanLine(y), THUMBNAIL_WIDTH * 4);
+        cache->insert(mediaPath, i, image);
+        emit thumbnailReady(i);
+        generated++;
+    }
+    av_frame_free(&frame);
+    avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+
+    if (serial != currentSerial || generated == 0)
+        return;
+    qDebug() << "thumbnails generated:" << generated << "/" << count << "time(ms):" << Clock::nowMs() - start;
+
+    QString path = ThumbnailCache::spritePath(mediaPath);
+    QDir dir = QFileInfo(path).absoluteDir();
+    if (path.isEmpty() || !dir.mkpath("."))
+        return;
+    // 先写失败列表: sprite替换后读取方一定能看到与之对应的列表
+    if (!saveFailedList(mediaPath, failed))
+    {
+        qDebug() << "thumbnail failed list write failed:" << ThumbnailCache::failedListPath(mediaPath);
+        return;
+    }
+    QSaveFile file(path); // 先写临时文件再替换, 读取方不会读到写了一半的文件
+    if (!file.open(QIODevice::WriteOnly) || !sprite.save(&file, "JPG", SPRITE_QUALITY) || !file.commit())
+    {
+        qDebug() << "thumbnail sprite write failed:" << path;
+        return;
+    }
+
+    QFileInfoList sprites = dir.entryInfoList(QStringList() << "*.jpg", QDir::Files, QDir::Time); // 最新的在前
+    for (int i = MAX_SPRITE_FILES; i < sprites.size(); i++)
+    {
+        QFile::remove(sprites[i].absoluteFilePath());
+        QFile::remove(sprites[i].absolutePath() + "/" + sprites[i].completeBaseName() + ".failed");
+    }
+}
+
+bool ThumbnailGenerator::saveFailedList(const QString &mediaPath, const QVector<int> &failed)
+{
+    QString path = ThumbnailCache::failedListPath(mediaPath);
+    if (failed.isEmpty())
+        return !QFile::exists(path) || QFile::remove(path);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+    for (int i : failed)
+        file.write(QByteArray::number(i) + "\n");
+    return file.commit();
+}
+
+bool ThumbnailGenerator::decodeKeyframe(AVFormatContext *formatContext, AVCodecContext *codecContext, int streamIndex, AVFrame *frame, int serial)
+{
+    AVPacket *packet = av_packet_alloc();
+    bool decoded = false;
+    while (!decoded && serial == currentSerial && av_read_frame(formatContext, packet) >= 0)
+    {
+        if (packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY))
+        {
+            // 送入后立即冲刷, 帧级多线程/帧重排的解码器也不必等待后续包即可输出
+            if (avcodec_send_packet(codecContext, packet) >= 0 && avcodec_send_packet(codecContext, nullptr) >= 0)
+                decoded = avcodec_receive_frame(codecContext, frame) >= 0;
+            avcodec_flush_buffers(codecContext);
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    return decoded;
+}
+
+QImage ThumbnailGenerator::scaleFrame(const AVFrame *frame, int height)
+{
+    swsContext = sws_getCachedContext(swsContext, frame->width, frame->height, AVPixelFormat(frame->format),
+                                      THUMBNAIL_WIDTH, height, AV_PIX_FMT_RGB32, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (swsContext == nullptr)
+        return QImage();
+
+    // 直接缩放到QImage的像素缓冲, AV_PIX_FMT_RGB32与QImage::Format_RGB32同为本机字节序的0xAARRGGBB
+    QImage image(THUMBNAIL_WIDTH, height, QImage::Format_RGB32);
+    uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+    int dstStride[4] = {image.bytesPerLine(), 0, 0, 0};
+    sws_scale(swsContext, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    return image;
+}
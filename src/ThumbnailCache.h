@@ -0,0 +1,94 @@
+#pragma once
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct SwsContext;
+
+// 进度条悬停预览的缩略图缓存: 内存中保存当前媒体的整套缩略图, 磁盘上每个文件保存一张拼接全部缩略图的图片(sprite)
+// 及生成失败的序号列表, 失败的缩略图在sprite中为空白, 载入时跳过
+// 缩略图按固定间隔取样, 第index张为index * intervalMs处之前最近的关键帧; 间隔与张数只由时长决定
+// 界面线程查找, 生成线程写入, 各方法均可在任意线程调用
+class ThumbnailCache
+{
+private:
+    mutable QMutex mutex;
+    mutable QCache<int, QImage> images; // 键为缩略图序号, 开销按KB计, 容量随首张缩略图扩大到整套的大小
+    QString mediaPath;
+    int64_t intervalMs{0};
+    int count{0};
+
+public:
+    ThumbnailCache();
+    ThumbnailCache(const ThumbnailCache &) = delete;
+    ThumbnailCache &operator=(const ThumbnailCache &) = delete;
+
+    // 取样间隔(ms)与张数
+    static int64_t intervalFor(int64_t durationMs);
+    static int countFor(int64_t durationMs);
+    // sprite文件路径, 与探测缓存使用同一文件键, 非本地文件返回空
+    static QString spritePath(const QString &mediaPath);
+    // 生成失败的缩略图序号列表文件, 与sprite同名, 每行一个序号
+    static QString failedListPath(const QString &mediaPath);
+
+    // 切换到新的媒体, 清空缓存
+    void reset(const QString &mediaPath, int64_t durationMs);
+    void insert(const QString &mediaPath, int index, const QImage &image);
+    // 取pts_ms处的缩略图, 未生成或已被淘汰时返回false, index输出对应的序号
+    bool find(int64_t pts_ms, QImage *image, int *index = nullptr) const;
+
+    QString getMediaPath() const;
+    int getCount() const;
+};
+
+// 后台生成缩略图, 运行在独立的低优先级线程中, 不使用播放解码器
+// 有sprite文件时直接切分载入, 否则用独立的AVFormatContext与软件解码器逐个跳转到取样点, 只解码关键帧并缩小
+class ThumbnailGenerator : public QObject
+{
+    Q_OBJECT
+signals:
+    // 第index张缩略图已加入缓存
+    void thumbnailReady(int index);
+
+public slots:
+    // 载入或生成mediaPath的全部缩略图, serial已过期(被cancel)时中止
+    void generate(const QString &mediaPath, qint64 durationMs, int serial);
+    // 重新载入被内存缓存淘汰的一张缩略图
+    void reload(const QString &mediaPath, int index, int serial);
+
+private:
+    ThumbnailCache *cache;
+    std::atomic<int> currentSerial{0};
+    SwsContext *swsContext{nullptr}; // 缩小, 源尺寸/格式不变时复用
+
+    static int interruptCallback(void *opaque);
+
+    // 从sprite文件切分出缩略图, 跳过生成失败的序号; 文件不存在或布局不符时返回false
+    bool loadSprite(const QString &mediaPath, int index = -1);
+    // 写出生成失败的序号列表, 没有失败时删除旧的列表
+    static bool saveFailedList(const QString &mediaPath, const QVector<int> &failed);
+    // 解码生成全部缩略图并写出sprite文件
+    void decodeAll(const QString &mediaPath, int64_t durationMs, int serial);
+    // 读到streamIndex流的下一个关键帧并解码出一帧, 读到文件末尾或被取消时返回false
+    bool decodeKeyframe(AVFormatContext *formatContext, AVCodecContext *codecContext, int streamIndex, AVFrame *frame, int serial);
+    // 缩小为THUMBNAIL_WIDTH x height的RGB32图片
+    QImage scaleFrame(const AVFrame *frame, int height);
+
+public:
+    explicit ThumbnailGenerator(ThumbnailCache *cache, QObject *parent = nullptr) : QObject(parent), cache(cache) {}
+    ~ThumbnailGenerator();
+
+    // 任意线程调用, 返回新请求的序号, 同时使进行中的生成失效
+    int nextSerial() { return ++currentSerial; }
+    // 任意线程调用, 中止进行中的生成
+    void cancel() { ++currentSerial; }
+    int getSerial() const { return currentSerial; }
+};
@@ -0,0 +1,175 @@
+#include "TraceWriter.h"
+#include "MediaClock.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QThread>
+#include <cmath>
+
+#define TRACE_ENV_VAR "PLAYER_TRACE"
+#define MAX_TRACE_EVENTS 2000000       // 记录上限, 约80MB, 超出后丢弃新事件
+#define TRACE_WRITE_CHUNK (1024 * 1024) // 写出时每积累这么多字节写一次文件
+
+std::atomic<bool> TraceWriter::enabled{false};
+
+TraceWriter *TraceWriter::instance()
+{
+    static TraceWriter *writer = new TraceWriter();
+    return writer;
+}
+
+void TraceWriter::startFromEnvironment()
+{
+    QString path = QString::fromLocal8Bit(qgetenv(TRACE_ENV_VAR));
+    if (!path.isEmpty())
+        start(path);
+}
+
+void TraceWriter::start(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    filePath = path;
+    eventCount = 0;
+    for (ThreadBuffer *buffer : buffers)
+    {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        buffer->events.clear();
+    }
+    enabled = true;
+    qDebug() << "trace enabled, output:" << filePath;
+}
+
+void TraceWriter::stop()
+{
+    QMutexLocker locker(&mutex);
+    if (!enabled)
+        return;
+    enabled = false;
+
+    if (writeFile())
+        qDebug() << "trace written:" << filePath << "events:" << qMin<int64_t>(eventCount.load(), MAX_TRACE_EVENTS);
+    else
+        qDebug() << "trace write failed:" << filePath;
+}
+
+TraceWriter::ThreadBuffer *TraceWriter::currentBuffer()
+{
+    // 缓冲在进程内不释放, 线程退出后其记录仍可写出
+    static thread_local ThreadBuffer *threadBuffer = nullptr;
+    if (threadBuffer)
+        return threadBuffer;
+
+    threadBuffer = new ThreadBuffer();
+    QThread *thread = QThread::currentThread();
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && thread == app->thread())
+        threadBuffer->name = "main";
+    else
+        threadBuffer->name = thread->objectName();
+
+    QMutexLocker locker(&mutex);
+    threadBuffer->tid = buffers.size() + 1;
+    if (threadBuffer->name.isEmpty())
+        threadBuffer->name = QString("thread %1").arg(threadBuffer->tid);
+    buffers.append(threadBuffer);
+    return threadBuffer;
+}
+
+void TraceWriter::append(const Event &event)
+{
+    if (eventCount.fetch_add(1, std::memory_order_relaxed) >= MAX_TRACE_EVENTS)
+        return;
+
+    ThreadBuffer *buffer = currentBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events.append(event);
+}
+
+void TraceWriter::span(const char *name, double startMs)
+{
+    if (!isEnabled())
+        return;
+    instance()->append({name, 'X', startMs, Clock::nowMs() - startMs, nullptr});
+}
+
+void TraceWriter::complete(const char *name, double startMs, double durationMs)
+{
+    if (!isEnabled())
+        return;
+    instance()->append({name, 'X', startMs, durationMs, nullptr});
+}
+
+void TraceWriter::asyncBegin(const char *name, const void *id)
+{
+    if (!isEnabled())
+        return;
+    instance()->append({name, 'b', Clock::nowMs(), 0.0, id});
+}
+
+void TraceWriter::asyncEnd(const char *name, const void *id)
+{
+    if (!isEnabled())
+        return;
+    instance()->append({name, 'e', Clock::nowMs(), 0.0, id});
+}
+
+bool TraceWriter::writeFile()
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out;
+    out.reserve(TRACE_WRITE_CHUNK + 4096);
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto separator = [&out, &first]()
+    {
+        if (!first)
+            out.append(",\n");
+        first = false;
+    };
+
+    for (ThreadBuffer *buffer : buffers)
+    {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        separator();
+        out.append(QString::asprintf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lld,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                                     static_cast<long long>(pid), buffer->tid, buffer->name.toUtf8().constData())
+                       .toUtf8());
+
+        for (const Event &event : buffer->events)
+        {
+            separator();
+            // 时间单位为us
+            if (event.phase == 'X')
+                out.append(QString::asprintf("{\"name\":\"%s\",\"cat\":\"player\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lld,\"tid\":%d}",
+                                             event.name, event.startMs * 1000.0, event.durationMs * 1000.0, static_cast<long long>(pid), buffer->tid)
+                               .toUtf8());
+            else
+                out.append(QString::asprintf("{\"name\":\"%s\",\"cat\":\"player\",\"ph\":\"%c\",\"id\":\"%p\",\"ts\":%.3f,\"pid\":%lld,\"tid\":%d}",
+                                             event.name, event.phase, event.id, event.startMs * 1000.0, static_cast<long long>(pid), buffer->tid)
+                               .toUtf8());
+
+            if (out.size() >= TRACE_WRITE_CHUNK)
+            {
+                file.write(out);
+                out.clear();
+            }
+        }
+        buffer->events.clear();
+    }
+    out.append("\n]}\n");
+    return file.write(out) == out.size();
+}
+
+TraceSpan::TraceSpan(const char *name) : name(name), startMs(TraceWriter::isEnabled() ? Clock::nowMs() : NAN)
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (!std::isnan(startMs))
+        TraceWriter::span(name, startMs);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+
+// 播放流水线时间线记录, 输出Chrome trace-event格式的JSON, 可在chrome://tracing或ui.perfetto.dev中查看
+// 设置环境变量PLAYER_TRACE=<输出文件>时启用, 程序退出时写出; 未启用时每个记录点只有一次原子读取
+// 各线程写入各自的缓冲(首次记录时注册), 缓冲锁只在写出时才有竞争
+class TraceWriter
+{
+private:
+    struct Event
+    {
+        const char *name; // 只接受字符串常量, 记录时不分配内存
+        char phase;       // 'X': 完整区间, 'b'/'e': 跨线程区间的开始/结束
+        double startMs;
+        double durationMs;
+        const void *id; // 跨线程区间的配对标识
+    };
+
+    struct ThreadBuffer
+    {
+        QMutex mutex;
+        QVector<Event> events;
+        int tid;
+        QString name;
+    };
+
+    static std::atomic<bool> enabled;
+
+    QMutex mutex; // 保护buffers与启动/停止
+    QVector<ThreadBuffer *> buffers;
+    QString filePath;
+    std::atomic<int64_t> eventCount{0};
+
+    TraceWriter() = default;
+
+    ThreadBuffer *currentBuffer();
+    void append(const Event &event);
+    bool writeFile();
+
+public:
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    static TraceWriter *instance();
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // 环境变量PLAYER_TRACE非空时开始记录
+    void startFromEnvironment();
+    void start(const QString &filePath);
+    // 停止记录并写出文件, 未启用时无操作
+    void stop();
+
+    // 以下记录函数在未启用时直接返回
+    // 当前线程从startMs(Clock::nowMs时间轴)到现在的一段区间
+    static void span(const char *name, double startMs);
+    static void complete(const char *name, double startMs, double durationMs);
+    // 跨线程区间, 由begin所在线程开始, 由end所在线程以相同id结束, 如排队信号从发出到处理
+    static void asyncBegin(const char *name, const void *id);
+    static void asyncEnd(const char *name, const void *id);
+};
+
+// 作用域内的一段区间, 未启用时不读取时钟
+class TraceSpan
+{
+private:
+    const char *name;
+    double startMs;
+
+public:
+    explicit TraceSpan(const char *name);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
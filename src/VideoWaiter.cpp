@@ -1,16 +1,280 @@
 #include "VideoWaiter.h"
-#include <QThread>
+#include "PipelineStats.h"
+#include "TraceWriter.h"
+#include "playerCommand.h"
+#include <QDebug>
+#include <QtGlobal>
+#include <cmath>
 
-void VideoWaiter::recvVideoFrame(uint8_t *data, int pixelWidth, int pixelHeight, double pts)
+#define DEFAULT_FRAME_DURATION_MS 40.0 // 无法由时间戳估算帧间隔时按25fps处理
+#define MAX_CLOCK_DIFF_MS 1000.0       // 帧时间戳与时钟相差超过此值视为跳转, 重新对齐时钟
+#define MIN_FRAME_GAP_MS 500.0         // 超过此时长未收到帧视为暂停过, 重新对齐时钟
+#define MAX_DROP_IN_ROW 5              // 最多连续丢帧数, 保证画面持续刷新
+#define SYNC_RECHECK_MS 10.0           // 跟随音频等待时距目标超过此值则先挂起一段再重新读取时钟, 音频时钟校正后及时修正目标时刻
+
+void VideoWaiter::presentLoop()
+{
+    FrameScheduler::TimerResolutionGuard timerGuard;
+    bool firstFrame = true;
+    stepPending = false;
+    while (control->getState() == CONTL_TYPE::PLAY)
+    {
+        double pts = 0.0;
+        int serial = 0;
+        double waitStart = Clock::nowMs();
+        AVFrame *frame = frameQueue->pop(&pts, true, &serial);
+        if (frame == nullptr) // 队列已中止
+            break;
+        double popped = Clock::nowMs();
+        PipelineStats::instance()->record(PipelineStats::STAGE_PRESENT_QUEUE_WAIT, popped - waitStart);
+        PipelineStats::instance()->recordDepth(PipelineStats::DEPTH_VIDEO_FRAMES, frameQueue->count());
+
+        // 帧数据不拷贝, 引用随信号交给渲染窗口
+        if (!presentFrame(frame, pts))
+        { // 等待中暂停/停止: 该帧放回队首, 恢复播放或步进时再输出, 视频时钟不越过正在播放的音频
+            frameQueue->pushFront(frame, pts, serial);
+            break;
+        }
+        PipelineStats::instance()->record(PipelineStats::STAGE_PRESENT_SYNC_WAIT, Clock::nowMs() - popped);
+        PipelineStats::instance()->endSeek(serial);
+
+        if (firstFrame)
+        { // 暂停期间帧队列保持满, 恢复后首帧应在一个帧间隔内输出
+            firstFrame = false;
+            resumeLatencyMs = Clock::nowMs() - control->getLastPlayTimeMs();
+            qDebug() << "resume to first frame(ms):" << resumeLatencyMs;
+        }
+    }
+
+    const Histogram &lateness = scheduler.getLatenessHistogram();
+    if (lateness.count() > 0)
+        qDebug() << "frame lateness(us):" << lateness.summary() << "spin margin(ms):" << scheduler.getSpinMarginMs();
+}
+
+bool VideoWaiter::presentFrame(AVFrame *frame, double pts)
+{
+    double prevPts = lastFramePts;
+    double frameDuration = pts - lastFramePts;
+    if (lastFramePts < 0 || frameDuration <= 0 || frameDuration > MAX_CLOCK_DIFF_MS)
+        frameDuration = DEFAULT_FRAME_DURATION_MS;
+    lastFramePts = pts;
+
+    bool presented = mediaClock->getMasterType() == MediaClock::AUDIO_MASTER
+                         ? presentWithAudioClock(frame, pts, frameDuration)
+                         : presentWithExternalClock(frame, pts, frameDuration);
+    if (!presented)
+        lastFramePts = prevPts;
+    return presented;
+}
+
+bool VideoWaiter::dropIfLate(AVFrame *frame, double lateMs, double frameDuration)
+{
+    // 落后超过一帧, 丢弃以追上时钟; 连续丢帧有上限, 保证画面持续刷新
+    if (lateMs <= frameDuration || droppedInRow >= MAX_DROP_IN_ROW)
+    {
+        droppedInRow = 0;
+        return false;
+    }
+
+    av_frame_free(&frame);
+    droppedInRow++;
+    droppedFrames++;
+    return true;
+}
+
+bool VideoWaiter::presentWithAudioClock(AVFrame *frame, double pts, double frameDuration)
+{
+    // 音频时钟已扣除设备中排队的数据, 为当前正在播放的采样的时间戳
+    // 由音频时钟换算出该帧在单调时钟上的目标时刻; 距目标较远时先挂起一段再重新读取时钟,
+    // 音频时钟在设备取数据时被校正, 目标时刻随之修正, 最后一段交给调度器精确等待
+    const Clock &audio = mediaClock->audio();
+    double deadline = NAN;
+    while (true)
+    {
+        double now = Clock::nowMs();
+        double delay = pts - audio.get(); // 序号锁读取, 不经过信号
+        // 时钟未知或相差过大说明刚跳转, 音频时钟尚未更新, 不等待也不计入延迟统计
+        if (std::isnan(delay) || std::fabs(delay) >= MAX_CLOCK_DIFF_MS)
+        {
+            deadline = NAN;
+            break;
+        }
+
+        deadline = now + delay;
+        if (delay <= SYNC_RECHECK_MS)
+        {
+            if (!scheduler.waitUntil(deadline))
+                return false;
+            break;
+        }
+        if (!scheduler.waitUntil(deadline - SYNC_RECHECK_MS))
+            return false;
+    }
+
+    double lateMs = std::isnan(deadline) ? 0.0 : Clock::nowMs() - deadline;
+    if (dropIfLate(frame, lateMs, frameDuration))
+        return true;
+
+    TraceWriter::asyncBegin("queued_signal", frame);
+    emit sendFrame(frame);
+    if (!std::isnan(deadline))
+        scheduler.recordPresent(deadline);
+    mediaClock->video().set(pts);
+    return true;
+}
+
+void VideoWaiter::onStepFrame()
 {
-    emit getAudioClock(audioClock);
+    // 不阻塞: 队列中有帧时直接输出, 否则等视频解码线程补解一帧后由onStepDecoded输出;
+    // 已到流末尾时不会再有帧, 阻塞在此会使之后的播放/跳转命令都无法执行
+    stepPending = !presentStepFrame();
+}
+
+void VideoWaiter::onStepDecoded()
+{
+    if (stepPending && control->getState() == CONTL_TYPE::PAUSE)
+        presentStepFrame();
+    stepPending = false;
+}
 
-    int sleepTime = pts - audioClock;
-    // qDebug() << "sleepTime: " << QString("%1").arg(sleepTime, 4, 10, QLatin1Char('0'))
-    //          << "pts: " << QString::number(pts, 'f', 3)
-    //          << "audioClock: " << QString::number(audioClock, 'f', 3)
-    //          << "currentTime: " << QDateTime::currentMSecsSinceEpoch() % 1000000;
-    if (sleepTime > 0 && audioClock >= 0.1)
-        QThread::msleep(sleepTime);
-    emit sendFrame(data, pixelWidth, pixelHeight);
+bool VideoWaiter::presentStepFrame()
+{
+    double pts = 0.0;
+    int serial = 0;
+    AVFrame *frame = frameQueue->pop(&pts, false, &serial);
+    if (frame == nullptr)
+        return false;
+
+    presentPaused(frame, pts);
+    updateVideoClock(pts);
+    PipelineStats::instance()->endSeek(serial); // 暂停时跳转后步进显示目标帧
+    return true;
+}
+
+void VideoWaiter::onScrubFrame()
+{
+    // 不阻塞: 预览帧已在队列中, 或已因新的预览/跳转被清空
+    double pts = 0.0;
+    int serial = 0;
+    AVFrame *frame = frameQueue->pop(&pts, false, &serial);
+    if (frame == nullptr)
+        return;
+
+    // 进度条由拖动控制, 不更新视频时钟对应的进度
+    presentPaused(frame, pts);
+    PipelineStats::instance()->endSeek(serial);
+}
+
+void VideoWaiter::onCachedStepFrame()
+{
+    // 不阻塞: 帧已在队列中, 或已因跳转/开始播放被清空
+    presentStepFrame();
+}
+
+void VideoWaiter::reverseLoop()
+{
+    // 帧按时间戳从大到小到达, 每帧的目标时刻为锚点时刻加上与锚点帧的时间戳之差
+    double anchorMs = NAN;
+    double anchorPts = 0.0;
+    while (control->getState() == CONTL_TYPE::PAUSE)
+    {
+        double pts = 0.0;
+        // 队列为空(正在解码上一段GOP)时阻塞, 倒放结束时由解码线程唤醒
+        AVFrame *frame = frameQueue->popWhile(&pts, [this]()
+                                              { return control->isReverse() && control->getState() == CONTL_TYPE::PAUSE; });
+        if (frame == nullptr) // 倒放结束且已显示完, 或队列已中止
+            break;
+
+        double frameDuration = lastFramePts - pts;
+        if (lastFramePts < 0 || frameDuration <= 0 || frameDuration > MAX_CLOCK_DIFF_MS)
+            frameDuration = DEFAULT_FRAME_DURATION_MS;
+        double now = Clock::nowMs();
+        double deadline = anchorMs + (anchorPts - pts);
+        // 首帧, 或解码下一段GOP使输出落后超过一帧时以当前帧重新对齐, 之后不追赶
+        if (std::isnan(anchorMs) || now - deadline > frameDuration || deadline - now > MAX_CLOCK_DIFF_MS)
+        {
+            anchorMs = now;
+            anchorPts = pts;
+            deadline = now;
+        }
+
+        while (now < deadline && control->waitWhileState(CONTL_TYPE::PAUSE, static_cast<unsigned long>(std::ceil(deadline - now))))
+            now = Clock::nowMs();
+        if (control->getState() != CONTL_TYPE::PAUSE)
+        {
+            av_frame_free(&frame);
+            break;
+        }
+        presentPaused(frame, pts);
+        updateVideoClock(pts);
+    }
+}
+
+void VideoWaiter::presentPaused(AVFrame *frame, double pts)
+{
+    lastFramePts = pts;
+    TraceWriter::asyncBegin("queued_signal", frame);
+    emit sendFrame(frame);
+    mediaClock->video().set(pts);
+    mediaClock->video().setPaused(true);
+}
+
+void VideoWaiter::onInitClock()
+{
+    stepPending = false;
+    lastFramePts = -1.0;
+    lastRecvMs = 0.0;
+    droppedInRow = 0;
+    lastPtsSeconds = -1;
+    droppedFrames = 0;
+    scheduler.reset();
+}
+
+bool VideoWaiter::presentWithExternalClock(AVFrame *frame, double pts, double frameDuration)
+{
+    if (asFastAsPossible)
+    { // 取到即输出, 解码速度只受帧队列容量约束
+        TraceWriter::asyncBegin("queued_signal", frame);
+        emit sendFrame(frame);
+        mediaClock->video().set(pts);
+        updateVideoClock(pts);
+        return true;
+    }
+
+    double now = Clock::nowMs();
+    double gap = now - lastRecvMs;
+    lastRecvMs = now;
+
+    // 首帧, 暂停恢复, 跳转后以当前帧重新对齐时钟
+    Clock &externalClock = mediaClock->external();
+    double clock = externalClock.get();
+    if (!externalClock.isValid() || gap > qMax(MIN_FRAME_GAP_MS, frameDuration * 3) || qAbs(pts - clock) > MAX_CLOCK_DIFF_MS)
+    {
+        externalClock.set(pts, now);
+        clock = pts;
+    }
+
+    double delay = pts - clock;
+    double deadline = now + delay;
+    if (delay > 0 && !scheduler.waitUntil(deadline))
+        return false;
+    if (dropIfLate(frame, -delay, frameDuration))
+        return true;
+
+    TraceWriter::asyncBegin("queued_signal", frame);
+    emit sendFrame(frame);
+    scheduler.recordPresent(deadline);
+    mediaClock->video().set(pts);
+    updateVideoClock(pts);
+    return true;
+}
+
+void VideoWaiter::updateVideoClock(double pts)
+{
+    int curPtsSeconds = pts / 1000.0;
+    if (curPtsSeconds != lastPtsSeconds)
+    {
+        lastPtsSeconds = curPtsSeconds;
+        emit videoClockChanged(curPtsSeconds);
+    }
 }
@@ -1,23 +1,93 @@
 #pragma once
+#include "FrameQueue.h"
+#include "FrameScheduler.h"
+#include "MediaClock.h"
+#include "PlayerControl.h"
+#include <QMetaType>
 #include <QObject>
+#include <atomic>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+Q_DECLARE_METATYPE(AVFrame *)
 
 class VideoWaiter : public QObject
 {
     Q_OBJECT
 signals:
-    // 发送当前帧画面
-    void sendFrame(uint8_t *pixelData, int pixelWidth, int pixelHeight);
+    // 发送当前帧画面, 接收方取得该帧引用的所有权, 用完以av_frame_free释放
+    void sendFrame(AVFrame *frame);
+
+    // 非音频为主时钟时由视频时钟驱动进度条
+    void videoClockChanged(int pts_s);
 
-    // 通过在信号连接时使用关键词Qt::DirectConnection, 来实现在video线程调用audio线程函数并获取数据
-    void getAudioClock(double &pts);
 public slots:
-    void recvVideoFrame(uint8_t *data, int pixelWidth, int pixelHeight, double pts);
+    // 显示循环, 从解码帧队列取帧并按时钟输出, 直到暂停/停止
+    void presentLoop();
+
+    // 打开媒体时调用, 重置帧间隔估算与丢帧统计
+    void onInitClock();
+
+    // 暂停时取一帧直接输出, 不等待时钟; 队列为空时等到单帧解码结束再取
+    void onStepFrame();
+
+    // 单帧解码已结束, 补上步进时队列为空而未输出的帧
+    void onStepDecoded();
+
+    // 拖动预览帧已解出, 直接输出; 已被新预览取代的帧在出队时丢弃
+    void onScrubFrame();
+
+    // 后退/从GOP缓存前进的帧已送入帧队列, 直接输出
+    void onCachedStepFrame();
+
+    // 倒放循环: 按相邻帧的时间戳间隔输出倒序到达的帧, 直到倒放结束且已送出的帧显示完, 或离开暂停状态
+    void reverseLoop();
 
 private:
+    FrameQueue *frameQueue;
+    MediaClock *mediaClock;
+    const PlayerControl *control; // 控制播放状态
+    FrameScheduler scheduler;     // 按目标时刻精确输出帧并统计输出延迟
+
     // double lastPtsMs = 0;     // 上一个包的时间戳(单位ms)
-    double audioClock;
+
+    std::atomic<bool> asFastAsPossible{false};
+
+    bool stepPending = false;   // 步进时帧队列为空, 等待视频解码线程解出
+    double lastFramePts = -1.0; // 上一帧时间戳(ms), 用于估算帧间隔
+    double lastRecvMs = 0.0;    // 上一帧到达时的单调时间(ms)
+    int droppedInRow = 0;       // 连续丢帧数
+    int lastPtsSeconds = -1;
+    std::atomic<int64_t> droppedFrames{0};
+    std::atomic<double> resumeLatencyMs{0.0}; // 最近一次播放命令投递到首帧输出的延迟
+
+    // 按主时钟等待并输出一帧(或丢帧); 等待被暂停/停止打断时不输出, 返回false, 帧仍归调用方
+    bool presentFrame(AVFrame *frame, double pts);
+    // 暂停时输出一帧, 视频时钟停在该帧
+    void presentPaused(AVFrame *frame, double pts);
+    // 不阻塞地取一帧作为步进画面输出, 队列为空时返回false
+    bool presentStepFrame();
+    // 输出时已落后主时钟lateMs毫秒, 超过一帧则释放该帧并返回true
+    bool dropIfLate(AVFrame *frame, double lateMs, double frameDuration);
+    // 以音频时钟为主时钟时等待音频播放到该帧, 落后超过一帧则丢帧
+    bool presentWithAudioClock(AVFrame *frame, double pts, double frameDuration);
+    // 以视频/外部时钟为主时钟时按外部时钟等待, 落后超过一帧则丢帧
+    bool presentWithExternalClock(AVFrame *frame, double pts, double frameDuration);
+    void updateVideoClock(double pts);
 
 public:
-    VideoWaiter(QObject *parent = nullptr) : QObject(parent) {}
+    VideoWaiter(FrameQueue *frameQueue, MediaClock *mediaClock, const PlayerControl *control, QObject *parent = nullptr)
+        : QObject(parent), frameQueue(frameQueue), mediaClock(mediaClock), control(control), scheduler(control) {}
     ~VideoWaiter() {}
+
+    // 尽快模式: 不以音频为主时钟时不按帧率等待也不丢帧, 逐帧尽快输出, 用于批量处理无声素材
+    void setAsFastAsPossible(bool enable) { asFastAsPossible = enable; }
+    // 输出前因落后主时钟而丢弃的帧数
+    int64_t getDroppedFrames() const { return droppedFrames; }
+    double getResumeLatencyMs() const { return resumeLatencyMs; }
+    // 每帧实际输出时刻相对目标时刻的延迟(us), 用于检验播放节奏
+    const Histogram &getLatenessHistogram() const { return scheduler.getLatenessHistogram(); }
 };
@@ -1,9 +1,14 @@
 #include "decode.h"
+#include "Demuxer.h"
+#include "FrameBufferPool.h"
+#include "ProbeCache.h"
+#include "TraceWriter.h"
 #include "playerCommand.h"
 #include <QDebug>
 #include <QImage>
 #include <QPixmap>
 #include <QThread>
+#include <cmath>
 
 class AVPacketUniquePtr : public std::unique_ptr<AVPacket, void (*)(AVPacket *)>
 {
@@ -38,18 +43,77 @@ public:
     AVFrameUniquePtr &operator=(AVFrame *other) { return *this = AVFrameUniquePtr(other); }
 };
 
-#define MAX_AUDIO_FRAME_SIZE 192000
+#define PCM_BUFFER_DURATION_MS 100 // 重采样输出缓冲时长, 更长的帧分多次取出
+#define PCM_RING_FILL_MS 300        // 音频解码超前输出的时长
+
+#define AUDIO_DIFF_AVG_NB 20             // 音频偏差取平均所需的最少帧数
+#define AUDIO_DIFF_THRESHOLD_MS 5.0      // 平均偏差超过此值才做重采样补偿
+#define AUDIO_NOSYNC_THRESHOLD_MS 1000.0 // 偏差超过此值视为跳转, 不做补偿
+#define SAMPLE_CORRECTION_PERCENT_MAX 10 // 每帧最多增减的采样比例
+
+#define DEFAULT_VIDEO_FRAME_DURATION_MS 40.0 // 无法由时间戳估算帧间隔时按25fps处理
+#define VIDEO_NOSYNC_THRESHOLD_MS 1000.0     // 视频与主时钟相差超过此值视为跳转, 不做落后处理
+#define SKIP_ESCALATE_FRAMES 12              // 连续落后此帧数后提高一级降级等级
+#define SKIP_RECOVER_FRAMES 50               // 连续领先此帧数后降低一级降级等级
+#define MAX_VIDEO_DROP_IN_ROW 5              // 解码端最多连续丢帧数, 保证画面持续刷新
+
+#define AUDIO_PACKET_QUEUE_MAX_BYTES (1 * 1024 * 1024)  // 音频包队列字节上限
+#define VIDEO_PACKET_QUEUE_MAX_BYTES (16 * 1024 * 1024) // 视频包队列字节上限
+#define PACKET_QUEUE_MAX_DURATION_MS 2000.0             // 单个包队列缓存时长上限(ms)
+#define VIDEO_FRAME_QUEUE_SIZE 3                        // 视频解码帧队列容量
+#define MAX_AUTO_THREAD_COUNT 16                        // 自动模式线程数上限, 再多收益很小且延迟和内存增加
+#define FAST_PROBE_SIZE (512 * 1024)                    // 快速探测读取的字节上限(默认5MB)
+#define FAST_ANALYZE_DURATION_US 500000                 // 快速探测分析的时长上限(默认5s)
+
 QString av_get_pixelformat_name(AVPixelFormat format);
 
-Decoder::Decoder(const int *_type, QObject *parent)
+Decoder::Decoder(PlayerControl *control, QObject *parent)
     : QObject(parent),
       formatContext(nullptr),
+      audioPacketQueue(AUDIO_PACKET_QUEUE_MAX_BYTES, PACKET_QUEUE_MAX_DURATION_MS),
+      videoPacketQueue(VIDEO_PACKET_QUEUE_MAX_BYTES, PACKET_QUEUE_MAX_DURATION_MS),
+      videoFrameQueue(&videoPacketQueue, VIDEO_FRAME_QUEUE_SIZE),
       mediaType(UNKNOWN),
-      m_type(_type)
+      control(control)
 {
     avformat_network_init(); // Initialize FFmpeg network components
-    audioDecoder = new AudioDecoder(this);
-    videoDecoder = new VideoDecoder(this);
+    audioDecoder = new AudioDecoder(&audioPacketQueue, &audioRingBuffer, &mediaClock, control);
+    audioDecodeThread = new QThread();
+    audioDecodeThread->setObjectName("audio_decode");
+    audioDecoder->moveToThread(audioDecodeThread);
+    audioDecodeThread->start(QThread::HighPriority); // 音频断续比视频掉帧更明显, 优先调度
+    connect(this, &Decoder::startAudioDecode, audioDecoder, &AudioDecoder::decodeLoop);
+    connect(audioDecoder, &AudioDecoder::decodeEnd, this, &Decoder::playOver); // 音频为主时钟, 音频解码完即播放结束
+
+    videoDecoder = new VideoDecoder(&videoPacketQueue, &videoFrameQueue, &mediaClock, control);
+    videoDecodeThread = new QThread();
+    videoDecodeThread->setObjectName("video_decode");
+    videoDecoder->moveToThread(videoDecodeThread);
+    videoDecodeThread->start();
+    connect(this, &Decoder::startVideoDecode, videoDecoder, &VideoDecoder::decodeLoop);
+    connect(this, &Decoder::stepVideo, videoDecoder, &VideoDecoder::decodeStep);
+    connect(this, &Decoder::scrubVideo, videoDecoder, &VideoDecoder::decodeScrub);
+    connect(this, &Decoder::stepVideoCached, videoDecoder, &VideoDecoder::decodeStepCached);
+    connect(this, &Decoder::reverseVideo, videoDecoder, &VideoDecoder::decodeReverse);
+    connect(videoDecoder, &VideoDecoder::reverseEnd, this, &Decoder::onReverseEnd);
+    connect(videoDecoder, &VideoDecoder::decodeEnd, this, &Decoder::onVideoDecodeEnd);
+
+    demuxer = new Demuxer(&audioPacketQueue, &videoPacketQueue);
+    demuxThread = new QThread();
+    demuxThread->setObjectName("demux");
+    demuxer->moveToThread(demuxThread);
+    demuxThread->start();
+
+    keyframeIndexer = new KeyframeIndexer();
+    indexThread = new QThread();
+    indexThread->setObjectName("keyframe_index");
+    keyframeIndexer->moveToThread(indexThread);
+    indexThread->start(QThread::LowestPriority); // 只在空闲时扫描, 不与播放争抢
+    connect(this, &Decoder::buildKeyframeIndex, keyframeIndexer, &KeyframeIndexer::build);
+    connect(keyframeIndexer, &KeyframeIndexer::indexBuilt, this, &Decoder::onKeyframeIndexBuilt);
+
+    // 总是排队执行, 解码线程自身发起的请求也等当前命令处理完再打开
+    connect(this, &Decoder::openRequested, this, &Decoder::onOpenRequested, Qt::QueuedConnection);
 
     // 遍历出设备支持的硬件类型
     enum AVHWDeviceType print_type = AV_HWDEVICE_TYPE_NONE;
@@ -62,19 +126,176 @@ Decoder::Decoder(const int *_type, QObject *parent)
 
 Decoder::~Decoder()
 {
+    clean();
+
+    keyframeIndexer->deleteLater();
+    indexThread->quit();
+    indexThread->wait();
+    indexThread->deleteLater();
+
+    demuxer->deleteLater();
+    audioDecoder->deleteLater();
+    videoDecoder->deleteLater();
+
+    demuxThread->quit();
+    demuxThread->wait();
+    demuxThread->deleteLater();
+
+    audioDecodeThread->quit();
+    audioDecodeThread->wait();
+    audioDecodeThread->deleteLater();
+
+    videoDecodeThread->quit();
+    videoDecodeThread->wait();
+    videoDecodeThread->deleteLater();
 }
 
 void Decoder::setVideoPath(const QString &filePath)
 {
+    openMedia(filePath, ++openSerial);
+}
+
+int Decoder::openAsync(const QString &filePath)
+{
+    int serial = ++openSerial; // 同时使正在进行的打开失效
+    emit openRequested(filePath, serial);
+    return serial;
+}
+
+void Decoder::setExactSeek(bool enabled)
+{
+    exactSeek = enabled;
+}
+
+void Decoder::setProbeMode(PROBE_MODE mode)
+{
+    probeMode = mode;
+}
+
+void Decoder::setProbeCacheEnabled(bool enabled)
+{
+    probeCacheEnabled = enabled;
+}
+
+void Decoder::cancelOpen()
+{
+    ++openSerial;
+}
+
+void Decoder::onOpenRequested(const QString &filePath, int serial)
+{
+    if (serial != openSerial)
+    {
+        emit openFailed(serial, OPEN_CANCELED);
+        return;
+    }
+
+    int error = openMedia(filePath, serial);
+    if (error == NO_ERROR)
+        emit mediaReady(serial, collectMediaInfo(filePath));
+    else
+        emit openFailed(serial, error);
+}
+
+int Decoder::openMedia(const QString &filePath, int serial)
+{
+    double start = Clock::nowMs();
+    openingSerial = serial;
     clean();
-    if (NO_ERROR == initFFmpeg(filePath))
+    int error = isOpenCanceled() ? OPEN_CANCELED : initFFmpeg(filePath);
+    openingSerial = 0;
+    openMs = Clock::nowMs() - start;
+
+    if (error == NO_ERROR)
     {
-        qDebug() << "init FFmpeg success";
+        qDebug() << "init FFmpeg success, open(ms):" << openMs << "probe:" << probeResult;
+        control->setState(CONTL_TYPE::NONE); // 新媒体从头播放, 开始播放时无需resume
+        videoFrameQueue.start();
+        // 纯音频(含封面图的MP3)不读取视频流, 避免封面包占住视频队列
+        demuxer->start(formatContext, audioStreamIndex, mediaType == ONLY_AUDIO ? -1 : videoStreamIndex);
+        mediaPath = filePath;
+        videoDecoder->mediaPath = filePath;
+        loadKeyframeIndex();
     }
     else
     {
         qDebug() << "init FFmpeg failed";
     }
+    return error;
+}
+
+void Decoder::loadKeyframeIndex()
+{
+    // 纯音频每个包都可作为跳转点, 无需索引
+    if (mediaType == ONLY_AUDIO || !KeyframeIndex::isSupported(formatContext))
+        return;
+    if (!keyframeIndex.load(mediaPath, defaltStreamIndex))
+        emit buildKeyframeIndex(mediaPath, defaltStreamIndex, keyframeIndexer->nextSerial());
+}
+
+void Decoder::onKeyframeIndexBuilt(const QString &filePath, int streamIndex)
+{
+    if (formatContext && filePath == mediaPath && streamIndex == defaltStreamIndex && !keyframeIndex.isLoaded())
+        keyframeIndex.load(filePath, streamIndex);
+}
+
+bool Decoder::isOpenCanceled() const
+{
+    int serial = openingSerial;
+    return serial != 0 && serial != openSerial;
+}
+
+int Decoder::interruptCallback(void *opaque)
+{
+    return static_cast<const Decoder *>(opaque)->isOpenCanceled() ? 1 : 0;
+}
+
+Decoder::MediaInfo Decoder::collectMediaInfo(const QString &filePath) const
+{
+    MediaInfo info;
+    info.filePath = filePath;
+    info.mediaType = mediaType;
+    info.durationMs = getDuration();
+    info.formatName = formatContext->iformat->name;
+    info.probeResult = probeResult;
+    info.openMs = openMs;
+
+    if (audioStreamIndex != -1)
+    {
+        const AVCodecContext *codecContext = audioDecoder->codecContext;
+        info.audioCodec = avcodec_get_name(codecContext->codec_id);
+        info.sampleRate = codecContext->sample_rate;
+        info.channels = codecContext->ch_layout.nb_channels;
+    }
+    if (videoStreamIndex != -1 && mediaType != ONLY_AUDIO)
+    {
+        const AVCodecContext *codecContext = videoDecoder->codecContext;
+        info.videoCodec = avcodec_get_name(codecContext->codec_id);
+        info.width = codecContext->width;
+        info.height = codecContext->height;
+        AVRational frameRate = formatContext->streams[videoStreamIndex]->avg_frame_rate;
+        info.frameRate = frameRate.den > 0 ? av_q2d(frameRate) : 0.0;
+        if (videoDecoder->hw_device_type != AV_HWDEVICE_TYPE_NONE)
+            info.hwDevice = av_hwdevice_get_type_name(videoDecoder->hw_device_type);
+    }
+    return info;
+}
+
+QString Decoder::openStageName(int stage)
+{
+    switch (stage)
+    {
+    case OPEN_INPUT:
+        return "opening";
+    case OPEN_PROBE:
+        return "probing";
+    case OPEN_AUDIO_CODEC:
+        return "audio codec";
+    case OPEN_VIDEO_CODEC:
+        return "video codec";
+    default:
+        return "unknown";
+    }
 }
 
 int64_t Decoder::getAudioFrameCount() const
@@ -128,48 +349,231 @@ QList<QString> Decoder::getSupportedHwDecoderNames()
     return ret;
 }
 
+void Decoder::setThreadConfig(AVMediaType type, THREAD_POLICY policy, int threadCount)
+{
+    if (policy == THREAD_FIXED && threadCount <= 0)
+        policy = THREAD_AUTO;
+
+    if (type == AVMEDIA_TYPE_AUDIO)
+        audioThreadConfig = {policy, threadCount};
+    else if (type == AVMEDIA_TYPE_VIDEO)
+        videoThreadConfig = {policy, threadCount};
+}
+
 bool Decoder::resume()
 {
     if (formatContext == nullptr)
         return false;
 
+    audioDecoder->pendingSeekTargetMs = NAN;
+    videoDecoder->pendingSeekTargetMs = NAN;
+    videoDecoder->scrubSerial = -1;
+    stepDetached = false;
     clearPacketQueue();
-    av_seek_frame(formatContext, -1, 0, AVSEEK_FLAG_BACKWARD);
+    demuxer->seek(-1, 0);
     return true;
 }
 
-void Decoder::setCurFrame(int64_t curPts_s)
+void Decoder::processCommands()
 {
-    if (formatContext == nullptr)
-        return;
+    // 拖动时预览命令成串到达, 只执行连续预览命令中的最后一条, 之前的不跳转直接确认
+    PlayerCommand command;
+    PlayerCommand scrub;
+    bool hasScrub = false;
+    while (true)
+    {
+        bool taken = control->take(&command);
+        if (taken && command.type == CMD_SCRUB)
+        {
+            if (hasScrub)
+                control->acknowledge(scrub);
+            scrub = command;
+            hasScrub = true;
+            continue;
+        }
 
-    clearPacketQueue();
-    int curPts_ms = curPts_s * 1000;
-    int64_t timestamp = curPts_ms / defalt_time_base_q2d_ms;
-    // qDebug() << "curPts_ms: " << curPts_ms << "timestamp :" << timestamp;
-    av_seek_frame(formatContext, defaltStreamIndex, timestamp, AVSEEK_FLAG_BACKWARD);
+        if (hasScrub)
+        {
+            runCommand(scrub);
+            hasScrub = false;
+        }
+        if (!taken)
+            break;
+        runCommand(command);
+    }
 }
 
-int Decoder::initFFmpeg(const QString &filePath)
+void Decoder::runCommand(const PlayerCommand &command)
 {
-    try
+    CONTL_TYPE oldState = control->getState();
+    applyCommand(command);
+    if (control->getState() != oldState)
+        emit stateChanged(control->getState());
+    double latency = control->acknowledge(command);
+    qDebug() << "player command:" << playerCommandName(command.type) << "state:" << control->getState()
+             << "latency(ms):" << latency;
+}
+
+void Decoder::applyCommand(const PlayerCommand &command)
+{
+    CONTL_TYPE state = control->getState();
+    bool hasVideo = mediaType == ONLY_VIDEO || mediaType == MULTI_AUDIO_VIDEO;
+    if (command.type != CMD_REVERSE) // 其他任何命令都结束倒放
+        stopReverse();
+
+    switch (command.type)
     {
-        formatContext = avformat_alloc_context();
+    case CMD_PLAY:
+        if (state == CONTL_TYPE::STOP || state == CONTL_TYPE::RESUME)
+        {
+            resume();
+        }
+        else if (stepDetached)
+        { // 从后退/倒放停留的画面继续播放: 精确跳转到该帧
+            double shown = mediaClock.video().snapshot().pts;
+            if (!std::isnan(shown))
+            {
+                PipelineStats::instance()->beginSeek(command.postTimeMs, videoPacketQueue.getSerial() + 1);
+                seekTo(std::llround(shown), true);
+            }
+        }
+        control->setState(CONTL_TYPE::PLAY);
+        decodePacket();
+        emit startPlay();
+        break;
+
+    case CMD_PAUSE: // 各线程处理完当前包/帧后退出循环
+        if (state != CONTL_TYPE::NONE)
+            control->setState(CONTL_TYPE::PAUSE);
+        break;
+
+    case CMD_SEEK:
+        // 跳转延迟从投递命令算起, 到跳转后第一帧显示为止
+        if (hasVideo)
+            PipelineStats::instance()->beginSeek(command.postTimeMs, videoPacketQueue.getSerial() + 1);
+        seekTo(command.arg, exactSeek);
+        break;
+
+    case CMD_SCRUB:
+        if (state == CONTL_TYPE::PAUSE && hasVideo && formatContext)
+        {
+            PipelineStats::instance()->beginSeek(command.postTimeMs, videoPacketQueue.getSerial() + 1, PipelineStats::STAGE_SCRUB);
+            seekTo(command.arg, false);
+            // 解复用线程执行跳转后还会清空一次, 之后读入的包serial不小于此值
+            videoDecoder->scrubSerial = videoPacketQueue.getSerial() + 1;
+            emit scrubVideo();
+        }
+        break;
+
+    case CMD_STOP:
+        control->setState(CONTL_TYPE::STOP);
+        audioRingBuffer.interruptWait();
+        break;
 
-        if (avformat_open_input(&formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0)
+    case CMD_STEP:
+        if (state == CONTL_TYPE::PAUSE && hasVideo)
         {
-            throw OPEN_STREAM_ERROR;
+            if (stepDetached)
+                emit stepVideoCached(1, false);
+            else
+                emit stepVideo();
         }
+        break;
+
+    case CMD_STEP_BACK:
+        if (state == CONTL_TYPE::PAUSE && hasVideo && formatContext)
+            emit stepVideoCached(-1, detachVideo());
+        break;
 
-        if (avformat_find_stream_info(formatContext, nullptr) < 0)
+    case CMD_REVERSE:
+        if (control->isReverse())
         {
-            throw FIND_INFO_ERROR;
+            stopReverse();
         }
+        else if ((state == CONTL_TYPE::PLAY || state == CONTL_TYPE::PAUSE) && hasVideo && formatContext)
+        {
+            control->setState(CONTL_TYPE::PAUSE);
+            control->setReverse(true);
+            emit reverseVideo(detachVideo());
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Decoder::seekTo(int64_t pts_ms, bool exact)
+{
+    if (formatContext == nullptr)
+        return;
+
+    // 目标须在清空包队列(serial自增)之前写入, 解码线程在取到新serial的包时读取
+    double target = exact ? static_cast<double>(pts_ms) : NAN;
+    audioDecoder->pendingSeekTargetMs = target;
+    videoDecoder->pendingSeekTargetMs = target;
+    videoDecoder->scrubSerial = -1; // 进行中的预览被本次跳转取代, 预览请求在跳转之后重新写入
+    stepDetached = false;
+    clearPacketQueue();
+    int64_t timestamp = pts_ms / defalt_time_base_q2d_ms;
+    // qDebug() << "pts_ms: " << pts_ms << "timestamp :" << timestamp;
+    // 有关键帧索引时直接定位到目标之前最近的关键帧
+    const KeyframeIndex::Entry *keyframe = keyframeIndex.find(timestamp);
+    if (keyframe)
+        demuxer->seek(defaltStreamIndex, timestamp, keyframe->pos, keyframe->pts);
+    else
+        demuxer->seek(defaltStreamIndex, timestamp);
+}
+
+bool Decoder::detachVideo()
+{
+    if (stepDetached)
+        return false;
+    stepDetached = true;
+    // 解码位置之后的包与帧不再使用: 包队列serial自增使解码循环最后送入的帧失效,
+    // 清空帧队列使阻塞在写入上的解码循环退出, 之后的逐帧由同一线程执行
+    videoPacketQueue.flush();
+    videoFrameQueue.flush();
+    return true;
+}
+
+void Decoder::stopReverse()
+{
+    if (!control->isReverse())
+        return;
+    control->setReverse(false);
+    videoFrameQueue.flush(); // 已排队的倒放帧不再显示, 同时唤醒阻塞在写入上的倒放循环
+    videoFrameQueue.wakeReaders();
+}
+
+void Decoder::onReverseEnd()
+{
+    // 不清空帧队列, 已送出的帧继续按节奏显示完, 之后视频同步线程不再等待
+    control->setReverse(false);
+    videoFrameQueue.wakeReaders();
+}
+
+int Decoder::initFFmpeg(const QString &filePath)
+{
+    try
+    {
+        int serial = openingSerial;
+        emit openProgress(serial, OPEN_INPUT);
+        openInput(filePath);
+
+        emit openProgress(serial, OPEN_PROBE);
+        probeStreams(filePath);
 
         // av_dump_format(formatContext, 0, filePath.toUtf8().constData(), 0); // 打印流信息
 
+        emit openProgress(serial, OPEN_AUDIO_CODEC);
         audioStreamIndex = initAudioDecoder();
+        if (isOpenCanceled())
+            throw OPEN_CANCELED;
+        emit openProgress(serial, OPEN_VIDEO_CODEC);
         videoStreamIndex = initVideoDecoder(devices);
+        if (isOpenCanceled())
+            throw OPEN_CANCELED;
         qDebug() << "audioStreamIndex: " << audioStreamIndex << "videoStreamIndex: " << videoStreamIndex;
         if (audioStreamIndex == -1 && videoStreamIndex == -1)
         {
@@ -185,6 +589,15 @@ int Decoder::initFFmpeg(const QString &filePath)
 
         defaltStreamIndex = (mediaType == ONLY_AUDIO) ? audioStreamIndex : videoStreamIndex;
         defalt_time_base_q2d_ms = (mediaType == ONLY_AUDIO) ? audioDecoder->time_base_q2d_ms : videoDecoder->time_base_q2d_ms;
+
+        if (audioStreamIndex != -1)
+            audioPacketQueue.setTimeBase(audioDecoder->time_base_q2d_ms);
+        if (videoStreamIndex != -1)
+            videoPacketQueue.setTimeBase(videoDecoder->time_base_q2d_ms);
+
+        mediaClock.reset(mediaType != ONLY_VIDEO, mediaType != ONLY_AUDIO);
+        if (mediaType != ONLY_AUDIO)
+            emit initClock();
     }
     catch (FFMPEG_INIT_ERROR error)
     {
@@ -195,6 +608,56 @@ int Decoder::initFFmpeg(const QString &filePath)
     return NO_ERROR;
 }
 
+void Decoder::openInput(const QString &filePath)
+{
+    formatContext = avformat_alloc_context();
+    // 打开与探测期间可被新的打开请求中断, 网络流/慢速设备上不必等待超时
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = this;
+
+    // 失败时formatContext由ffmpeg释放并置空
+    if (avformat_open_input(&formatContext, filePath.toUtf8().constData(), nullptr, nullptr) != 0)
+        throw isOpenCanceled() ? OPEN_CANCELED : OPEN_STREAM_ERROR;
+}
+
+void Decoder::probeStreams(const QString &filePath)
+{
+    // 缓存命中且补全后参数齐全时无需探测
+    ProbeCache::Entry entry;
+    if (probeCacheEnabled && ProbeCache::load(filePath, &entry) && ProbeCache::apply(entry, formatContext) && ProbeCache::isComplete(formatContext))
+    {
+        probeResult = "cache";
+        return;
+    }
+
+    if (probeMode == PROBE_FAST)
+    {
+        formatContext->probesize = FAST_PROBE_SIZE;
+        formatContext->max_analyze_duration = FAST_ANALYZE_DURATION_US;
+        if (avformat_find_stream_info(formatContext, nullptr) < 0 || isOpenCanceled())
+            throw isOpenCanceled() ? OPEN_CANCELED : FIND_INFO_ERROR;
+
+        if (ProbeCache::isComplete(formatContext))
+        {
+            probeResult = "fast";
+            if (probeCacheEnabled)
+                ProbeCache::store(filePath, ProbeCache::fromFormatContext(formatContext));
+            return;
+        }
+
+        // 预算内未得到完整参数(如流开头缺少关键帧/参数集), 重新打开后按默认预算完整探测
+        qDebug() << "fast probe incomplete, falling back to full probe";
+        avformat_close_input(&formatContext);
+        openInput(filePath);
+    }
+
+    if (avformat_find_stream_info(formatContext, nullptr) < 0 || isOpenCanceled())
+        throw isOpenCanceled() ? OPEN_CANCELED : FIND_INFO_ERROR;
+    probeResult = "full";
+    if (probeCacheEnabled && ProbeCache::isComplete(formatContext))
+        ProbeCache::store(filePath, ProbeCache::fromFormatContext(formatContext));
+}
+
 int Decoder::initAudioDecoder()
 {
     auto &audioCodecContext = audioDecoder->codecContext;
@@ -207,7 +670,10 @@ int Decoder::initAudioDecoder()
     audioStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, &audioCodec, 0);
 
     if (audioStreamIndex == AVERROR_STREAM_NOT_FOUND)
+    {
+        emit initAudioOutput(0, 0); // 无音频流, 关闭上一个媒体的音频输出
         return -1;
+    }
     else if (audioStreamIndex == AVERROR_DECODER_NOT_FOUND)
         throw FIND_AUDIO_DECODER_ERROR;
 
@@ -232,6 +698,11 @@ int Decoder::initAudioDecoder()
 
     time_base_q2d_ms = av_q2d(formatContext->streams[audioStreamIndex]->time_base) * 1000;
 
+    audioDecoder->pcmBytesPerSample = audioCodecContext->ch_layout.nb_channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+    audioDecoder->pcmBufferSamples = audioCodecContext->sample_rate * PCM_BUFFER_DURATION_MS / 1000;
+    audioDecoder->pcmBuffer.resize(audioDecoder->pcmBufferSamples * audioDecoder->pcmBytesPerSample);
+    audioDecoder->ringFillBytes = static_cast<size_t>(audioCodecContext->sample_rate) * audioDecoder->pcmBytesPerSample * PCM_RING_FILL_MS / 1000;
+
     // 音频压缩编码格式
     if (AV_CODEC_ID_AAC == audioCodecContext->codec_id)
         qDebug() << "audio codec:AAC";
@@ -271,6 +742,18 @@ int Decoder::initVideoDecoder(QList<AVHWDeviceType> &devices)
 
     time_base_q2d_ms = av_q2d(formatContext->streams[videoStreamIndex]->time_base) * 1000;
 
+    // 帧级多线程下解码器需缓存(线程数-1)帧才开始输出
+    videoThreadLatencyMs = 0.0;
+    if (videoCodecContext->active_thread_type & FF_THREAD_FRAME)
+    {
+        AVRational frameRate = av_guess_frame_rate(formatContext, formatContext->streams[videoStreamIndex], nullptr);
+        double frameDurationMs = frameRate.num > 0 && frameRate.den > 0 ? 1000.0 / av_q2d(frameRate) : 40.0;
+        videoThreadLatencyMs = (videoCodecContext->thread_count - 1) * frameDurationMs;
+    }
+    qDebug() << "video decode threads: " << videoCodecContext->thread_count
+             << "type: " << ((videoCodecContext->active_thread_type & FF_THREAD_FRAME) ? "frame" : (videoCodecContext->active_thread_type & FF_THREAD_SLICE) ? "slice" : "none")
+             << "latency(ms): " << videoThreadLatencyMs;
+
     if (AV_CODEC_ID_H264 == videoCodec->id)
         qDebug() << "video codec:H264";
     else if (AV_CODEC_ID_HEVC == videoCodec->id)
@@ -351,14 +834,95 @@ int Decoder::initCodec(AVCodecContext **codecContext, AVCodecParameters *codecpa
         (*codecContext)->hw_device_ctx = av_buffer_ref(videoDecoder->hw_device_ctx);
         av_buffer_unref(&videoDecoder->hw_device_ctx);
     }
+    applyThreadConfig(*codecContext, codec);
     qDebug() << "(*codecContext)->codec_id: " << (*codecContext)->codec_id;
     return avcodec_open2(*codecContext, codec, nullptr);
 }
 
+void Decoder::applyThreadConfig(AVCodecContext *codecContext, const AVCodec *codec)
+{
+    const ThreadConfig &config = (codecContext->codec_type == AVMEDIA_TYPE_VIDEO) ? videoThreadConfig : audioThreadConfig;
+    bool frameCapable = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+    bool sliceCapable = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+
+    int threadCount = config.threadCount > 0 ? config.threadCount : autoThreadCount(codecContext);
+    switch (config.policy)
+    {
+    case THREAD_FRAME:
+        codecContext->thread_type = FF_THREAD_FRAME;
+        break;
+    case THREAD_SLICE:
+        codecContext->thread_type = FF_THREAD_SLICE;
+        break;
+    case THREAD_FIXED:
+        codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        break;
+    case THREAD_AUTO:
+    default:
+        // 直播等时长未知的源优先保证低延迟; 否则编码器支持时优先帧级多线程
+        if (frameCapable && !(formatContext && formatContext->duration == AV_NOPTS_VALUE))
+            codecContext->thread_type = FF_THREAD_FRAME;
+        else if (sliceCapable)
+            codecContext->thread_type = FF_THREAD_SLICE;
+        else
+            threadCount = 1;
+        break;
+    }
+    codecContext->thread_count = threadCount;
+}
+
+int Decoder::autoThreadCount(const AVCodecContext *codecContext) const
+{
+    // 音频解码计算量小, 多线程只会增加延迟; 硬解时CPU只做码流解析
+    if (codecContext->codec_type != AVMEDIA_TYPE_VIDEO || codecContext->hw_device_ctx != nullptr)
+        return 1;
+
+    int pixels = codecContext->width * codecContext->height;
+    int threadCount = 0;
+    if (pixels <= 1280 * 720)
+        threadCount = 4;
+    else if (pixels <= 1920 * 1080)
+        threadCount = 8;
+    else
+        threadCount = MAX_AUTO_THREAD_COUNT;
+
+    switch (codecContext->codec_id)
+    {
+    case AV_CODEC_ID_H264:
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_VP9:
+    case AV_CODEC_ID_AV1:
+        break;
+    default: // 较老的编码格式单帧计算量小, 线程过多反而增加同步开销
+        threadCount = qMin(threadCount, 4);
+        break;
+    }
+
+    return qBound(1, qMin(threadCount, QThread::idealThreadCount()), MAX_AUTO_THREAD_COUNT);
+}
+
 void Decoder::clean()
 {
+    keyframeIndexer->cancel();
+    keyframeIndex.close();
+    mediaPath.clear();
+
+    demuxer->stop(); // 同时中止包队列, 阻塞在取包上的解码循环随之退出
+    videoFrameQueue.abort();
+    audioRingBuffer.abortWait(); // 音频输出重新初始化时解除
+    {                // 等待音视频解码循环退出后再释放解码器
+        QMutexLocker audioLocker(&audioDecoder->loopMutex);
+        QMutexLocker videoLocker(&videoDecoder->loopMutex);
+    }
     clearPacketQueue();
     mediaType = UNKNOWN;
+    stepDetached = false;
+
+    // 各阶段统计按媒体累计, 切换媒体时输出并清零
+    QString stats = PipelineStats::instance()->summary();
+    if (!stats.isEmpty())
+        qDebug().noquote() << "pipeline stats:\n" + stats;
+    PipelineStats::instance()->reset();
 
     audioDecoder->clean();
     videoDecoder->clean();
@@ -373,375 +937,789 @@ void Decoder::clean()
 
 void Decoder::clearPacketQueue()
 {
-    if (videoDecoder && videoDecoder->codecContext)
-        avcodec_flush_buffers(videoDecoder->codecContext);
-
+    // 解码器由各自解码线程根据包的serial刷新
     audioDecoder->lastPts = -1.0;
     videoDecoder->lastPts = -1.0;
 
-    while (!audioPacketQueue.isEmpty())
+    audioPacketQueue.flush();
+    videoPacketQueue.flush();
+    videoFrameQueue.flush();
+    audioRingBuffer.interruptWait(); // 挂起中的音频解码放弃跳转前的数据
+    emit flushAudio(audioPacketQueue.getSerial());
+}
+
+void Decoder::decodePacket()
+{
+    if (control->getState() != CONTL_TYPE::PLAY)
+        return;
+
+    switch (mediaType)
     {
-        auto packet = audioPacketQueue.dequeue();
-        av_packet_free(&packet);
+    case ONLY_VIDEO:
+        decodeVideo();
+        break;
+    case ONLY_AUDIO:
+        emit startAudioDecode();
+        break;
+    case MULTI_AUDIO_VIDEO:
+        emit startAudioDecode();
+        emit startVideoDecode();
+        break;
+    default:
+        emit playOver();
+        debugPlayerCommand(CONTL_TYPE::END);
+        break;
     }
-    while (!videoPacketQueue.isEmpty())
+}
+
+void Decoder::decodeVideo()
+{
+    emit startVideoDecode();
+}
+
+void Decoder::onVideoDecodeEnd()
+{
+    if (mediaType == ONLY_VIDEO)
     {
-        auto packet = videoPacketQueue.dequeue();
-        av_packet_free(&packet);
+        emit playOver();
+        debugPlayerCommand(CONTL_TYPE::END);
     }
 }
 
-void Decoder::decodePacket()
+void AudioDecoder::decodeLoop()
 {
-    if (*m_type != CONTL_TYPE::PLAY)
-        return;
-
-    try
+    QMutexLocker loopLocker(&loopMutex);
+    // 不再按音频时钟节流, 环形缓冲中已缓存足够数据时写入等待即为背压
+    while (control->getState() == CONTL_TYPE::PLAY && codecContext)
     {
-        switch (mediaType)
-        {
-        case ONLY_VIDEO:
-            decodeVideo();
+        int serial = 0;
+        double waitStart = Clock::nowMs();
+        AVPacket *packet = packetQueue->pop(&serial);
+        if (packet == nullptr) // 队列已中止
             break;
-        case ONLY_AUDIO:
-            decodeAudio();
-            break;
-        case MULTI_AUDIO_VIDEO:
-            decodeMultMedia();
+        PipelineStats::instance()->record(PipelineStats::STAGE_AUDIO_PACKET_WAIT, Clock::nowMs() - waitStart);
+        PipelineStats::instance()->recordDepth(PipelineStats::DEPTH_AUDIO_PACKETS_MS, std::llround(packetQueue->durationMs()));
+
+        if (serial != packetSerial)
+        { // 跳转后的第一个包, 丢弃解码器中的旧数据
+            packetSerial = serial;
+            avcodec_flush_buffers(codecContext);
+            audioDiffCum = 0.0;
+            audioDiffAvgCount = 0;
+            seekTargetMs = pendingSeekTargetMs;
+        }
+
+        if (PacketQueue::isEofPacket(packet))
+        { // 送入空包冲刷出解码器中缓存的帧
+            decodeAudioPacket(packet);
+            emit decodeEnd();
+            debugPlayerCommand(CONTL_TYPE::END);
             break;
-        default:
-            throw (int)CONTL_TYPE::END;
         }
+        decodeAudioPacket(packet);
     }
-    catch (int controlType)
+}
+
+void AudioDecoder::clean()
+{
+    pendingSeekTargetMs = NAN;
+    seekTargetMs = NAN;
+
+    // 倒着清理
+    if (swrContext)
+        swr_free(&swrContext);
+
+    if (codecContext)
+        avcodec_free_context(&codecContext);
+}
+
+int AudioDecoder::transferFrameToPCM(AVFrame *frame)
+{
+    uint8_t *dstBuffer = pcmBuffer.data();
+    int convertedSize = swr_convert(                              // 返回转换出的样本数
+        swrContext,                                               // 转换工具
+        &dstBuffer,                                               // 输出
+        pcmBufferSamples,                                         // 输出缓冲可容纳的样本数, 放不下的留在重采样器中
+        frame ? (const uint8_t **)frame->extended_data : nullptr, // 输入
+        frame ? frame->nb_samples : 0);                           // 输入样本数
+
+    return convertedSize;
+}
+
+bool AudioDecoder::writeToRingBuffer(const uint8_t *data, int size, int *written)
+{
+    *written = 0;
+    size_t remaining = size;
+    while (remaining > 0)
     {
-        if (controlType == CONTL_TYPE::END)
-            emit playOver();
-        debugPlayerCommand(CONTL_TYPE(controlType));
+        // 暂停时继续挂起, 恢复后接着写
+        CONTL_TYPE state = control->getState();
+        if (state != CONTL_TYPE::PLAY && state != CONTL_TYPE::PAUSE)
+            return false;
+        if (packetQueue->getSerial() != packetSerial) // 已跳转, 剩余数据作废
+            return false;
+
+        // 已超前足够时长(正常的流量控制)或空间不足时挂起, 音频输出消费后唤醒
+        double waitStart = Clock::nowMs();
+        bool writable = ringBuffer->waitForWritable(ringFillBytes);
+        PipelineStats::instance()->record(PipelineStats::STAGE_AUDIO_WRITE_WAIT, Clock::nowMs() - waitStart);
+        if (!writable)
+        {
+            if (ringBuffer->isWaitAborted())
+                return false;
+            continue; // 被状态变化/跳转唤醒, 重新检查
+        }
+
+        // 空间不足时只写入一部分(计一次overrun), 剩余部分等输出消费后再写
+        size_t n = ringBuffer->write(data, remaining);
+        data += n;
+        remaining -= n;
+        *written += static_cast<int>(n);
     }
+    return true;
 }
 
-void Decoder::decodeAudio()
+void AudioDecoder::decodeAudioPacket(AVPacketUniquePtr packet)
 {
-    while (*m_type == CONTL_TYPE::PLAY)
+    decodeMs = 0.0;
+    receivedFrames = 0;
+
+    // 将音频包发送到音频解码器, 空包(data为空, size为0)使解码器进入冲刷状态
+    double start = Clock::nowMs();
+    int ret = avcodec_send_packet(codecContext, packet.get());
+    decodeMs += Clock::nowMs() - start;
+    TraceWriter::span("send_packet", start);
+    if (ret == AVERROR(EAGAIN))
+    { // 解码器输出未取完, 取完后重新送入
+        receiveFrames();
+        start = Clock::nowMs();
+        ret = avcodec_send_packet(codecContext, packet.get());
+        decodeMs += Clock::nowMs() - start;
+        TraceWriter::span("send_packet", start);
+    }
+
+    if (ret < 0 && ret != AVERROR_EOF)
+        qDebug() << "in audio avcodec_send_packet fail: " << ret;
+
+    // 一个包可能解出多帧, 需全部取出
+    receiveFrames();
+    PipelineStats::instance()->record(PipelineStats::STAGE_AUDIO_DECODE, decodeMs, receivedFrames, packet->size);
+}
+
+void AudioDecoder::receiveFrames()
+{
+    AVFrameUniquePtr frame;
+    int ret = 0;
+    while (true)
     {
-#if true
-        emit getCurPts(curPts);
-        if (curPts > audioDecoder->lastPts)
+        double start = Clock::nowMs();
+        ret = avcodec_receive_frame(codecContext, frame.get());
+        decodeMs += Clock::nowMs() - start;
+        TraceWriter::span("receive_frame", start);
+        if (ret != 0)
+            break;
+        receivedFrames++;
+
+        double framePts = time_base_q2d_ms * frame.get()->pts;
+        lastPts = framePts;
+
+        // 精确跳转: 丢弃目标之前的帧, 跨过目标的帧裁掉目标之前的采样点
+        int trimSamples = 0;
+        if (!std::isnan(seekTargetMs))
         {
-            AVPacketUniquePtr packet;
-            if (av_read_frame(formatContext, packet.get()) < 0)
+            double frameEnd = framePts + frame.get()->nb_samples * 1000.0 / codecContext->sample_rate;
+            if (frameEnd <= seekTargetMs)
             {
-                throw (int)CONTL_TYPE::END;
+                av_frame_unref(frame.get());
+                continue;
             }
+            trimSamples = std::max(0, static_cast<int>((seekTargetMs - framePts) * codecContext->sample_rate / 1000.0));
+            seekTargetMs = NAN;
+        }
 
-            if (packet->stream_index == audioStreamIndex)
-            {
-                // qDebug() << "audioStreamIndex, packet->pts: " << audioDecoder->time_base_q2d_ms * packet->pts;
-                if (*m_type == CONTL_TYPE::PLAY)
-                    audioDecoder->decodeAudioPacket(std::move(packet));
-            }
-            else
+        // 输入输出采样率相同, 补偿量直接以采样点计
+        int wantedSamples = synchronizeAudio(frame.get()->nb_samples);
+        if (wantedSamples != frame.get()->nb_samples)
+            swr_set_compensation(swrContext, wantedSamples - frame.get()->nb_samples, wantedSamples);
+
+        AVFrame *input = frame.get();
+        int convertedSize = 0;
+        while (true)
+        {
+            double convertStart = Clock::nowMs();
+            convertedSize = transferFrameToPCM(input);
+            if (convertedSize <= 0)
+                break;
+            int bufferSize = convertedSize * pcmBytesPerSample;
+            PipelineStats::instance()->record(PipelineStats::STAGE_AUDIO_CONVERT, Clock::nowMs() - convertStart, input ? 1 : 0, bufferSize);
+
+            int skipSamples = std::min(trimSamples, convertedSize);
+            trimSamples -= skipSamples;
+            if (skipSamples < convertedSize)
             {
-                qDebug() << "in audio unknow stream index: " << packet->stream_index;
+                int skipBytes = skipSamples * pcmBytesPerSample;
+                int written = 0;
+                bool complete = writeToRingBuffer(pcmBuffer.data() + skipBytes, bufferSize - skipBytes, &written);
+
+                // 通知音频播放器取数据; 通知经队列到达, 可能晚于跳转时的清空, 由serial判断是否已作废
+                if (written > 0)
+                    emit sendAudioBuffer(written, framePts + skipSamples * 1000.0 / codecContext->sample_rate, packetSerial);
+                if (!complete)
+                    break;
             }
+            if (convertedSize < pcmBufferSamples)
+                break;
+
+            // 输出缓冲已满, 继续取出重采样器中剩余的数据
+            framePts += convertedSize * 1000.0 / codecContext->sample_rate;
+            input = nullptr;
         }
-#else
-        while (audioDecoder->packetIsUsed == false)
-        {
-            if (*m_type != CONTL_TYPE::PLAY)
-                throw *m_type;
-            QThread::msleep(10);
-        }
 
-        AVPacket *packet = av_packet_alloc();
-        if (av_read_frame(formatContext, packet) < 0)
-            throw (int)CONTL_TYPE::END;
-        if (packet->stream_index == audioStreamIndex)
+        if (convertedSize < 0)
+            qDebug() << "in audio decode frame error";
+        av_frame_unref(frame.get());
+    }
+
+    if (ret == AVERROR_EOF) // 冲刷完毕, 重置解码器以便跳转后继续解码
+        avcodec_flush_buffers(codecContext);
+    else if (ret != AVERROR(EAGAIN))
+        qDebug() << "in audio avcodec_receive_frame fail: " << ret;
+}
+
+int AudioDecoder::synchronizeAudio(int nbSamples)
+{ // 参考ffplay synchronize_audio
+    if (mediaClock->getMasterType() == MediaClock::AUDIO_MASTER)
+        return nbSamples;
+
+    double diff = mediaClock->audio().get() - mediaClock->getMasterClock();
+    if (std::isnan(diff) || std::fabs(diff) >= AUDIO_NOSYNC_THRESHOLD_MS)
+    { // 时钟未就绪或刚跳转, 重新统计
+        audioDiffCum = 0.0;
+        audioDiffAvgCount = 0;
+        return nbSamples;
+    }
+
+    // 指数加权, AUDIO_DIFF_AVG_NB帧前的偏差权重衰减到1%
+    static const double avgCoef = std::exp(std::log(0.01) / AUDIO_DIFF_AVG_NB);
+    audioDiffCum = diff + avgCoef * audioDiffCum;
+    if (audioDiffAvgCount < AUDIO_DIFF_AVG_NB)
+    {
+        audioDiffAvgCount++;
+        return nbSamples;
+    }
+
+    double avgDiff = audioDiffCum * (1.0 - avgCoef);
+    if (std::fabs(avgDiff) < AUDIO_DIFF_THRESHOLD_MS)
+        return nbSamples;
+
+    // 音频超前则多输出采样拉长播放时间, 落后则少输出
+    int wantedSamples = nbSamples + static_cast<int>(diff * codecContext->sample_rate / 1000.0);
+    int minSamples = nbSamples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+    int maxSamples = nbSamples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100;
+    return qBound(minSamples, wantedSamples, maxSamples);
+}
+
+void VideoDecoder::clean()
+{
+    hw_device_pix_fmt = AV_PIX_FMT_NONE;
+
+    if (swsContext)
+    {
+        sws_freeContext(swsContext);
+        swsContext = nullptr;
+    }
+
+    qDebug() << "gop cache hits: " << gopCacheHits << "misses: " << gopCacheMisses << "frames: " << gopCache.count()
+             << "size(KB): " << gopCache.bytes() / 1024;
+    gopCache.clear(); // 缓存的帧占用帧缓冲池的缓冲, 先于整理缓冲池释放
+    gopDecoder.close();
+    mediaPath.clear();
+    cachedTimestamp = AV_NOPTS_VALUE;
+    stepTimestamp = AV_NOPTS_VALUE;
+    gopCacheHits = 0;
+    gopCacheMisses = 0;
+
+    auto stats = FrameBufferPool::instance()->getStats();
+    qDebug() << "frame buffer pool hits: " << stats.hits << "misses: " << stats.misses
+             << "resident(KB): " << stats.residentBytes / 1024 << "idle(KB): " << stats.idleBytes / 1024;
+    FrameBufferPool::instance()->trim(); // 下一个媒体分辨率可能不同, 释放空闲缓冲
+
+    qDebug() << "video dropped late: " << droppedLateFrames << "skipped: " << skippedFrames << "seek discarded: " << seekDiscardedFrames;
+    resetDropPolicy();
+    endExactSeek();
+    pendingSeekTargetMs = NAN;
+    droppedLateFrames = 0;
+    skippedFrames = 0;
+    seekDiscardedFrames = 0;
+    scrubSerial = -1;
+    scrubbedSerial = -1;
+    av_packet_free(&heldPacket);
+
+    if (codecContext)
+        avcodec_free_context(&codecContext);
+}
+
+void VideoDecoder::resetDropPolicy()
+{
+    lateInRow = 0;
+    onTimeInRow = 0;
+    droppedInRow = 0;
+    setSkipLevel(SKIP_NONE);
+}
+
+void VideoDecoder::endExactSeek()
+{
+    av_frame_free(&seekHeldFrame);
+    if (std::isnan(seekTargetMs))
+        return;
+    seekTargetMs = NAN;
+    if (codecContext)
+        codecContext->skip_frame = skipLevel >= SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+void VideoDecoder::setSkipLevel(int level)
+{
+    if (level == skipLevel)
+        return;
+    skipLevel = level;
+    if (codecContext == nullptr)
+        return;
+
+    // 解码线程内修改, 对之后送入的包生效
+    codecContext->skip_frame = level >= SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    codecContext->skip_loop_filter = level >= SKIP_LOOP_FILTER ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    qDebug() << "video skip level: " << level;
+}
+
+bool VideoDecoder::checkLate(double framePts)
+{
+    double frameDuration = framePts - lastPts;
+    if (lastPts < 0 || frameDuration <= 0 || frameDuration > VIDEO_NOSYNC_THRESHOLD_MS)
+        frameDuration = DEFAULT_VIDEO_FRAME_DURATION_MS;
+
+    // 视频为主时钟时不存在落后; 暂停步进, 时钟未知或相差过大(刚跳转)时不处理
+    double masterClock = mediaClock->getMasterClock();
+    double lag = masterClock - framePts;
+    if (mediaClock->getMasterType() == MediaClock::VIDEO_MASTER || control->getState() != CONTL_TYPE::PLAY ||
+        std::isnan(lag) || std::fabs(lag) > VIDEO_NOSYNC_THRESHOLD_MS)
+    {
+        lateInRow = 0;
+        onTimeInRow = 0;
+        droppedInRow = 0;
+        return false;
+    }
+
+    // 解码跟得上时帧队列保持满, 解出的帧领先主时钟; 解出即已落后说明解码速度不足
+    if (lag > frameDuration)
+    {
+        lateInRow++;
+        onTimeInRow = 0;
+        if (lateInRow >= SKIP_ESCALATE_FRAMES && skipLevel < SKIP_LOOP_FILTER)
         {
-            audioDecoder->packetIsUsed = false;
-            emit sendAudioPacket(packet);
+            setSkipLevel(skipLevel + 1);
+            lateInRow = 0;
         }
-        else
+    }
+    else if (lag < 0)
+    {
+        onTimeInRow++;
+        lateInRow = 0;
+        if (onTimeInRow >= SKIP_RECOVER_FRAMES && skipLevel > SKIP_NONE)
         {
-            qDebug() << "unknow stream index: " << packet->stream_index;
-            av_packet_free(&packet);
+            setSkipLevel(skipLevel - 1);
+            onTimeInRow = 0;
         }
-#endif
     }
+
+    // 已落后超过一帧的帧即使送出也会被显示端丢弃, 在格式转换前丢弃以节省转换与上传
+    if (lag > frameDuration && droppedInRow < MAX_VIDEO_DROP_IN_ROW)
+    {
+        droppedInRow++;
+        return true;
+    }
+    droppedInRow = 0;
+    return false;
 }
 
-void Decoder::decodeVideo()
+void VideoDecoder::decodeLoop()
 {
+    QMutexLocker loopLocker(&loopMutex);
+    // 不再按主时钟节流, 帧队列写满时阻塞即为背压
+    while (control->getState() == CONTL_TYPE::PLAY && codecContext)
+    {
+        bool eof = false;
+        if (!decodeNextPacket(&eof))
+            break;
+        // 有音频时由音频结束判定播放结束, 视频在此继续等待跳转或停止
+        if (eof)
+            emit decodeEnd();
+    }
 }
 
-void Decoder::decodeMultMedia()
+void VideoDecoder::decodeStep()
 {
-    while (*m_type == CONTL_TYPE::PLAY)
+    QMutexLocker loopLocker(&loopMutex);
+    int64_t delivered = deliveredFrames;
+    while (control->getState() == CONTL_TYPE::PAUSE && codecContext && deliveredFrames == delivered)
     {
-#if true
-        emit getCurPts(curPts);
-        if (curPts > audioDecoder->lastPts)
-        {
-            AVPacket *packet = nullptr;
-            if (!audioPacketQueue.isEmpty())
-            {
-                packet = audioPacketQueue.dequeue();
-            }
-            else
-            {
-                packet = av_packet_alloc();
-                if (av_read_frame(formatContext, packet) < 0)
-                {
-                    av_packet_free(&packet);
-                    throw (int)CONTL_TYPE::END;
-                }
-            }
+        bool eof = false;
+        if (!decodeNextPacket(&eof) || eof)
+            break;
+    }
+    emit stepDecoded(); // 到流末尾时没有新帧, 视频同步线程不再等待
+}
 
-            if (packet->stream_index == audioStreamIndex)
-            {
-                // qDebug() << "audioStreamIndex, packet->pts: " << audioDecoder->time_base_q2d_ms * packet->pts;
-                if (*m_type == CONTL_TYPE::PLAY)
-                    audioDecoder->decodeAudioPacket(packet);
-            }
-            else if (packet->stream_index == videoStreamIndex)
-            {
-                videoPacketQueue.enqueue(packet);
-            }
-            else
-            {
-                qDebug() << "in audio unknow stream index: " << packet->stream_index;
-                av_packet_free(&packet);
-            }
+void VideoDecoder::decodeScrub()
+{
+    QMutexLocker loopLocker(&loopMutex);
+    while (control->getState() == CONTL_TYPE::PAUSE && codecContext)
+    {
+        int requested = scrubSerial;
+        if (requested < 0 || scrubbedSerial >= requested)
+            break;
+
+        int serial = 0;
+        AVPacket *packet = popPacket(&serial);
+        if (packet == nullptr) // 队列已中止
+            break;
+        if (scrubSerial < 0 || control->getState() != CONTL_TYPE::PAUSE)
+        { // 等待期间已跳转或开始播放, 此包属于之后的解码
+            heldPacket = packet;
+            heldPacketSerial = serial;
+            break;
         }
 
-        if (curPts > videoDecoder->lastPts)
+        if (serial != packetSerial)
         {
-            AVPacket *packet = nullptr;
-            if (!videoPacketQueue.isEmpty())
-            {
-                packet = videoPacketQueue.dequeue();
-            }
-            else
-            {
-                packet = av_packet_alloc();
-                if (av_read_frame(formatContext, packet) < 0)
-                {
-                    av_packet_free(&packet);
-                    throw (int)CONTL_TYPE::END;
-                }
-            }
-
-            if (packet->stream_index == videoStreamIndex)
-            {
-                // qDebug() << "videoStreamIndex, packet->pts: " << videoDecoder->time_base_q2d_ms * packet->pts;
-                if (*m_type == CONTL_TYPE::PLAY)
-                    videoDecoder->decodeVideoPacket(packet);
-            }
-            else if (packet->stream_index == audioStreamIndex)
-            {
-                audioPacketQueue.enqueue(packet);
-            }
-            else
-            {
-                qDebug() << "in video unknow stream index: " << packet->stream_index;
-                av_packet_free(&packet);
-            }
+            packetSerial = serial;
+            avcodec_flush_buffers(codecContext);
+            resetDropPolicy();
+            endExactSeek();
+            cachedTimestamp = AV_NOPTS_VALUE;
         }
-#else
-        while (audioDecoder->packetIsUsed == false && videoDecoder->packetIsUsed == false)
+
+        // 跳转完成前读入的旧包, 以及关键帧之前的包, 都不解码
+        if (serial < scrubSerial || PacketQueue::isEofPacket(packet) || !(packet->flags & AV_PKT_FLAG_KEY))
         {
-            if (*m_type != CONTL_TYPE::PLAY)
-                throw *m_type;
-            QThread::msleep(10);
+            if (PacketQueue::isEofPacket(packet) && serial >= scrubSerial)
+                scrubbedSerial = serial; // 目标之后没有关键帧, 保留当前画面
+            av_packet_free(&packet);
+            continue;
         }
 
-        if (audioDecoder->packetIsUsed)
-        {
-            AVPacket *packet = nullptr;
-            if (!audioPacketQueue.isEmpty())
-            {
-                packet = audioPacketQueue.dequeue();
-            }
-            else
-            {
-                packet = av_packet_alloc();
-                if (av_read_frame(formatContext, packet) < 0)
-                    throw (int)CONTL_TYPE::END;
-            }
+        // 送入关键帧后立即冲刷, 帧级多线程/帧重排的解码器也不必等待后续包即可输出
+        int64_t delivered = deliveredFrames;
+        decodeVideoPacket(packet);
+        avcodec_send_packet(codecContext, nullptr);
+        receiveFrames();
+        if (deliveredFrames == delivered)
+            continue; // 未解出画面, 取下一个关键帧
+        scrubbedSerial = serial;
+        cachedTimestamp = AV_NOPTS_VALUE; // 之后的包从关键帧的下一个包接着解码, 与预览帧不一定相邻
+        emit scrubFrameReady();
+    }
+}
 
-            if (packet->stream_index == audioStreamIndex)
-            {
-                // qDebug() << "audioStreamIndex, packet->pts: " << audioDecoder->time_base_q2d_ms * packet->pts;
+void VideoDecoder::decodeStepCached(int direction, bool fromDisplayed)
+{
+    QMutexLocker loopLocker(&loopMutex);
+    if (control->getState() != CONTL_TYPE::PAUSE || codecContext == nullptr)
+        return;
 
-                audioDecoder->packetIsUsed = false;
-                emit sendAudioPacket(packet);
-            }
-            else if (packet->stream_index == videoStreamIndex)
-            {
-                videoPacketQueue.enqueue(packet);
-            }
-            else
-            {
-                qDebug() << "in audio unknow stream index: " << packet->stream_index;
-                av_packet_free(&packet);
-            }
-        }
-        if (videoDecoder->packetIsUsed)
-        {
-            AVPacket *packet = nullptr;
-            if (!videoPacketQueue.isEmpty())
-            {
-                packet = videoPacketQueue.dequeue();
-            }
-            else
-            {
-                packet = av_packet_alloc();
-                if (av_read_frame(formatContext, packet) < 0)
-                    throw (int)CONTL_TYPE::END;
-            }
+    frameQueue->flush(); // 倒放结束时未显示的帧
+    if (fromDisplayed || stepTimestamp == AV_NOPTS_VALUE)
+        stepTimestamp = displayedTimestamp();
+    if (stepTimestamp == AV_NOPTS_VALUE)
+        return;
 
-            if (packet->stream_index == videoStreamIndex)
-            {
-                // qDebug() << "videoStreamIndex, packet->pts: " << videoDecoder->time_base_q2d_ms * packet->pts;
+    // 已到第一帧/最后一帧时重新送出当前帧, 视频同步线程照常输出
+    int64_t timestamp = cachedNeighbor(stepTimestamp, direction);
+    if (timestamp == AV_NOPTS_VALUE)
+        timestamp = stepTimestamp;
+    if (!pushCachedFrame(timestamp, packetQueue->getSerial()))
+        return;
+    stepTimestamp = timestamp;
+    emit stepFrameReady();
+}
 
-                videoDecoder->packetIsUsed = false;
-                emit sendVideoPacket(packet);
-            }
-            else if (packet->stream_index == audioStreamIndex)
-            {
-                audioPacketQueue.enqueue(packet);
-            }
-            else
-            {
-                qDebug() << "in video unknow stream index: " << packet->stream_index;
-                av_packet_free(&packet);
-            }
+void VideoDecoder::decodeReverse(bool fromDisplayed)
+{
+    QMutexLocker loopLocker(&loopMutex);
+    if (codecContext == nullptr)
+        return;
+
+    frameQueue->flush(); // 上一次倒放结束时未显示的帧
+    int64_t timestamp = fromDisplayed || stepTimestamp == AV_NOPTS_VALUE ? displayedTimestamp() : stepTimestamp;
+    int serial = packetQueue->getSerial();
+    while (timestamp != AV_NOPTS_VALUE && control->isReverse() && control->getState() == CONTL_TYPE::PAUSE)
+    {
+        int64_t prev = cachedNeighbor(timestamp, -1);
+        if (prev == AV_NOPTS_VALUE)
+        {
+            emit reverseEnd();
+            break;
         }
-#endif
+        // 帧队列已满时阻塞, 倒放结束时被清空唤醒
+        if (!pushCachedFrame(prev, serial))
+            break;
+        timestamp = prev;
     }
+    // 结束时已送出的帧不一定都显示了, 之后的逐帧以视频时钟对应的帧为起点
+    stepTimestamp = AV_NOPTS_VALUE;
 }
 
-void AudioDecoder::clean()
+AVPixelFormat VideoDecoder::outputFormat() const
 {
-    // 倒着清理
-    if (swrContext)
-        swr_free(&swrContext);
+    return hw_device_type != AV_HWDEVICE_TYPE_NONE ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+}
 
-    if (codecContext)
-        avcodec_free_context(&codecContext);
+int64_t VideoDecoder::displayedTimestamp() const
+{
+    // 视频时钟由帧的时间戳按time_base_q2d_ms换算, 反算取整即还原
+    double pts = mediaClock->video().snapshot().pts;
+    if (std::isnan(pts) || time_base_q2d_ms <= 0)
+        return AV_NOPTS_VALUE;
+    return std::llround(pts / time_base_q2d_ms);
 }
 
-int AudioDecoder::transferFrameToPCM(AVFrame *frame, uint8_t *dstBuffer)
+int64_t VideoDecoder::cachedNeighbor(int64_t timestamp, int direction)
 {
-    int64_t out_nb_samples = av_rescale_rnd(
-        swr_get_delay(swrContext, frame->sample_rate) + frame->nb_samples,
-        44100,
-        frame->sample_rate,
-        AV_ROUND_UP);
+    int64_t neighbor = direction < 0 ? gopCache.prev(timestamp) : gopCache.next(timestamp);
+    if (neighbor != AV_NOPTS_VALUE)
+    {
+        gopCacheHits++;
+        return neighbor;
+    }
 
-    int convertedSize = swr_convert( // 返回转换出的数据大小
-        swrContext,                  // 转换工具
-        &dstBuffer,                  // 输出
-        out_nb_samples,              // 输出样本数
-        frame->data,                 // 输入
-        frame->nb_samples);          // 输入样本数
+    gopCacheMisses++;
+    if (!gopDecoder.isOpen() && !gopDecoder.open(mediaPath, videoStreamIndex, outputFormat()))
+    {
+        qDebug() << "gop decoder open failed:" << mediaPath;
+        return AV_NOPTS_VALUE;
+    }
 
-    return convertedSize;
+    // 一次解码的帧不超过预算的一半, 当前位置另一侧已缓存的帧得以保留
+    int64_t windowBytes = gopCache.getBudget() / 2;
+    int64_t cachedBytes = gopCache.bytes();
+    double start = Clock::nowMs();
+    int frames = direction < 0 ? gopDecoder.decodeBefore(timestamp, &gopCache, windowBytes)
+                               : gopDecoder.decodeAfter(timestamp, &gopCache, windowBytes);
+    PipelineStats::instance()->record(PipelineStats::STAGE_GOP_DECODE, Clock::nowMs() - start, frames, gopCache.bytes() - cachedBytes);
+    return direction < 0 ? gopCache.prev(timestamp) : gopCache.next(timestamp);
 }
 
-void AudioDecoder::decodeAudioPacket(AVPacketUniquePtr packet)
+bool VideoDecoder::pushCachedFrame(int64_t timestamp, int serial)
 {
-    // 将音频帧发送到音频解码器
-    if (avcodec_send_packet(codecContext, packet.get()) == 0)
-    {
-        AVFrameUniquePtr frame;
-        if (avcodec_receive_frame(codecContext, frame.get()) == 0)
-        {
-            std::unique_ptr<uint8_t[]> convertedAudioBuffer(new uint8_t[MAX_AUDIO_FRAME_SIZE]);
-            int convertedSize = transferFrameToPCM(frame.get(), convertedAudioBuffer.get());
-
-            if (convertedSize > 0)
-            {
-                int channels = frame.get()->ch_layout.nb_channels;
-                int bufferSize = av_samples_get_buffer_size(nullptr, channels, convertedSize, AV_SAMPLE_FMT_S16, 1);
-                double framePts = time_base_q2d_ms * frame.get()->pts;
+    const AVFrame *cached = gopCache.find(timestamp);
+    if (cached == nullptr)
+        return false;
+    AVFrame *frame = av_frame_clone(cached);
+    gopCache.trim(timestamp); // 以新位置为中心淘汰
+    return frame && frameQueue->push(frame, time_base_q2d_ms * timestamp, serial);
+}
 
-                lastPts = framePts;
-                // 将转换后的音频数据发送到音频播放器
-                emit sendAudioBuffer(convertedAudioBuffer.release(), bufferSize, framePts);
-            }
-            else
-            {
-                qDebug() << "in audio decode frame error";
-            }
-        }
-        else
+AVPacket *VideoDecoder::popPacket(int *serial)
+{
+    if (heldPacket)
+    {
+        AVPacket *packet = heldPacket;
+        heldPacket = nullptr;
+        if (heldPacketSerial == packetQueue->getSerial())
         {
-            qDebug() << "in audio decode frame error";
+            *serial = heldPacketSerial;
+            return packet;
         }
+        av_packet_free(&packet); // 之后又跳转过, 已失效
     }
+    return packetQueue->pop(serial);
 }
 
-void VideoDecoder::clean()
+bool VideoDecoder::decodeNextPacket(bool *eof)
 {
-    hw_device_pix_fmt = AV_PIX_FMT_NONE;
+    int serial = 0;
+    double waitStart = Clock::nowMs();
+    AVPacket *packet = popPacket(&serial);
+    if (packet == nullptr) // 队列已中止
+        return false;
+    PipelineStats::instance()->record(PipelineStats::STAGE_VIDEO_PACKET_WAIT, Clock::nowMs() - waitStart);
+    PipelineStats::instance()->recordDepth(PipelineStats::DEPTH_VIDEO_PACKETS_MS, std::llround(packetQueue->durationMs()));
+
+    if (serial != packetSerial)
+    { // 跳转后的第一个包, 丢弃解码器中的旧数据
+        packetSerial = serial;
+        avcodec_flush_buffers(codecContext);
+        resetDropPolicy();
+        endExactSeek();
+        seekTargetMs = pendingSeekTargetMs;
+        cachedTimestamp = AV_NOPTS_VALUE;
+    }
 
-    if (codecContext)
-        avcodec_free_context(&codecContext);
+    // 结束包为空包, 送入后冲刷出解码器中缓存的帧
+    *eof = PacketQueue::isEofPacket(packet);
+    decodeVideoPacket(packet);
+
+    // 目标在最后一帧之后: 显示最后一帧
+    if (*eof && !std::isnan(seekTargetMs))
+    {
+        AVFrame *frame = seekHeldFrame;
+        seekHeldFrame = nullptr;
+        endExactSeek();
+        if (frame)
+            return deliverFrame(frame);
+    }
+    return true;
 }
 
 void VideoDecoder::decodeVideoPacket(AVPacketUniquePtr packet)
 {
-    if (avcodec_send_packet(codecContext, packet.get()) == 0)
+    decodeMs = 0.0;
+    receivedFrames = 0;
+
+    // 精确跳转期间, 显示时间在目标之前的非参考帧既不显示也不被其他帧参考, 可不解码
+    // 包时长未知时按默认帧间隔估计, 宁可多解码也不跳过覆盖目标的帧
+    if (!std::isnan(seekTargetMs) && !PacketQueue::isEofPacket(packet.get()))
     {
-        auto frame = av_frame_alloc();
-        int ret = avcodec_receive_frame(codecContext, frame);
-        if (ret == 0)
-        {
-            double framePts = time_base_q2d_ms * frame->pts;
+        double packetDuration = packet->duration > 0 ? time_base_q2d_ms * packet->duration : DEFAULT_VIDEO_FRAME_DURATION_MS;
+        bool beforeTarget = packet->pts != AV_NOPTS_VALUE && !(packet->flags & AV_PKT_FLAG_KEY) &&
+                            time_base_q2d_ms * packet->pts + packetDuration <= seekTargetMs;
+        codecContext->skip_frame = beforeTarget || skipLevel >= SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
 
-            if (hw_device_type != AV_HWDEVICE_TYPE_NONE)
-                transferDataFromHW(&frame);
+    // 空包(data为空, size为0)使解码器进入冲刷状态, 输出所有因参考帧重排而缓存的帧
+    double start = Clock::nowMs();
+    int ret = avcodec_send_packet(codecContext, packet.get());
+    decodeMs += Clock::nowMs() - start;
+    TraceWriter::span("send_packet", start);
+    if (ret == AVERROR(EAGAIN))
+    { // 解码器输出未取完, 取完后重新送入
+        if (!receiveFrames())
+            return;
+        start = Clock::nowMs();
+        ret = avcodec_send_packet(codecContext, packet.get());
+        decodeMs += Clock::nowMs() - start;
+        TraceWriter::span("send_packet", start);
+    }
 
-            uint8_t *pixelData = nullptr;
-            switch (frame->format)
-            {
-            case AV_PIX_FMT_YUV420P:
-                pixelData = copyYuv420pData(frame->data, frame->linesize, frame->width, frame->height);
-                break;
-            case AV_PIX_FMT_NV12:
-                pixelData = copyNv12Data(frame->data, frame->linesize, frame->width, frame->height);
-                break;
-            default:
-                pixelData = copyDefaultData(frame);
-                break;
-            }
+    if (ret < 0 && ret != AVERROR_EOF)
+        qDebug() << "avcodec_send_packet fail: " << ret;
 
-            lastPts = framePts;
-            emit sendVideoFrame(pixelData, frame->width, frame->height, framePts);
-        }
-        else if (ret != AVERROR(EAGAIN))
+    // 帧重排或帧级多线程时一个包可能输出0或多帧, 需全部取出
+    receiveFrames();
+    PipelineStats::instance()->record(PipelineStats::STAGE_VIDEO_DECODE, decodeMs, receivedFrames, packet->size);
+
+    // 降级期间送入的包未产出帧, 视为被跳过
+    if (skipLevel != SKIP_NONE && receivedFrames == 0 && !PacketQueue::isEofPacket(packet.get()))
+        skippedFrames++;
+}
+
+bool VideoDecoder::receiveFrames()
+{
+    while (true)
+    {
+        AVFrame *frame = av_frame_alloc();
+        double start = Clock::nowMs();
+        int ret = avcodec_receive_frame(codecContext, frame);
+        decodeMs += Clock::nowMs() - start;
+        TraceWriter::span("receive_frame", start);
+        if (ret < 0)
         {
-            qDebug() << "avcodec_receive_frame fail: " << ret;
+            av_frame_free(&frame);
+            if (ret == AVERROR_EOF) // 冲刷完毕, 重置解码器以便跳转后继续解码
+                avcodec_flush_buffers(codecContext);
+            else if (ret != AVERROR(EAGAIN))
+                qDebug() << "avcodec_receive_frame fail: " << ret;
+            return true;
         }
-        else
+
+        receivedFrames++;
+        if (!deliverFrame(frame))
+            return false;
+    }
+}
+
+bool VideoDecoder::deliverFrame(AVFrame *frame)
+{
+    int64_t timestamp = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+    double framePts = time_base_q2d_ms * timestamp;
+
+    // 精确跳转: 目标之前的帧在下载/格式转换前丢弃, 保留最近一帧以防目标在流末尾之后
+    if (!std::isnan(seekTargetMs))
+    {
+        double frameDuration = frame->duration > 0 ? time_base_q2d_ms * frame->duration : DEFAULT_VIDEO_FRAME_DURATION_MS;
+        if (framePts + frameDuration <= seekTargetMs)
         {
-            qDebug() << "avcodec_receive_frame EAGAIN";
+            lastPts = framePts;
+            av_frame_free(&seekHeldFrame);
+            seekHeldFrame = frame;
+            seekDiscardedFrames++;
+            cachedTimestamp = AV_NOPTS_VALUE;
+            return true;
         }
+        endExactSeek();
+    }
+
+    if (checkLate(framePts))
+    {
+        lastPts = framePts;
         av_frame_free(&frame);
+        droppedLateFrames++;
+        cachedTimestamp = AV_NOPTS_VALUE;
+        return true;
     }
-    else
+
+    double convertStart = Clock::nowMs();
+    if (hw_device_type != AV_HWDEVICE_TYPE_NONE)
+        transferDataFromHW(&frame);
+
+    AVPixelFormat dstFormat = outputFormat();
+    if (frame != nullptr && frame->format != dstFormat)
+    {
+        AVFrame *dstFrame = transFrameToDstFmt(frame, frame->width, frame->height, dstFormat);
+        av_frame_free(&frame);
+        frame = dstFrame;
+    }
+
+    if (frame == nullptr) // 格式转换失败, 跳过此帧
+        return true;
+    PipelineStats::instance()->record(PipelineStats::STAGE_VIDEO_CONVERT, Clock::nowMs() - convertStart, 1,
+                                      av_image_get_buffer_size(AVPixelFormat(frame->format), frame->width, frame->height, 1));
+
+    lastPts = framePts;
+    // 同时存入GOP缓存, 暂停后后退时直接取用; 降级期间有帧被跳过, 不建立相邻关系
+    if (timestamp != AV_NOPTS_VALUE && gopCache.getBudget() > 0)
     {
-        qDebug() << "avcodec_send_packet fail";
+        gopCache.insert(timestamp, av_frame_clone(frame), skipLevel == SKIP_NONE ? cachedTimestamp : AV_NOPTS_VALUE);
+        gopCache.trim(timestamp);
+        cachedTimestamp = timestamp;
     }
+
+    // 帧队列已满时阻塞, 直到显示线程取走或队列中止
+    double waitStart = Clock::nowMs();
+    if (!frameQueue->push(frame, framePts, packetSerial))
+        return false;
+    PipelineStats::instance()->record(PipelineStats::STAGE_VIDEO_QUEUE_WAIT, Clock::nowMs() - waitStart);
+    deliveredFrames++;
+    return true;
 }
 
 void VideoDecoder::transferDataFromHW(AVFrame **frame)
 {
     // 如果采用的硬件加速, 解码后的数据还在GPU中, 所以需要通过av_hwframe_transfer_data将GPU中的数据转移到内存中
     // GPU解码数据格式固定为NV12, 来源: https://blog.csdn.net/qq_23282479/article/details/118993650
+    TraceSpan span("hw_transfer");
     AVFrameUniquePtr tmp_frame;
+    // 目标缓冲从帧缓冲池借出, 避免每帧分配整帧内存; 借不到时由ffmpeg自行分配
+    enum AVPixelFormat *formats = nullptr;
+    if (av_hwframe_transfer_get_formats((*frame)->hw_frames_ctx, AV_HWFRAME_TRANSFER_DIRECTION_FROM, &formats, 0) >= 0)
+    {
+        tmp_frame->format = formats[0];
+        tmp_frame->width = (*frame)->width;
+        tmp_frame->height = (*frame)->height;
+        av_freep(&formats);
+        if (FrameBufferPool::instance()->getFrameBuffer(tmp_frame.get()) < 0)
+            av_frame_unref(tmp_frame.get());
+    }
+
     if (0 > av_hwframe_transfer_data(tmp_frame.get(), *frame, 0))
     {
         qDebug() << "av_hwframe_transfer_data fail";
@@ -760,53 +1738,6 @@ void VideoDecoder::transferDataFromHW(AVFrame **frame)
     }
 }
 
-uint8_t *VideoDecoder::copyNv12Data(uint8_t **pixelData, int *linesize, int pixelWidth, int pixelHeight)
-{
-    uint8_t *pixel = new uint8_t[pixelWidth * pixelHeight * 3 / 2];
-    uint8_t *y = pixel;
-    uint8_t *uv = pixel + pixelWidth * pixelHeight;
-
-    int halfHeight = pixelHeight >> 1;
-    for (int i = 0; i < pixelHeight; i++)
-    {
-        memcpy(y + i * pixelWidth, pixelData[0] + i * linesize[0], static_cast<size_t>(pixelWidth));
-    }
-    for (int i = 0; i < halfHeight; i++)
-    {
-        memcpy(uv + i * pixelWidth, pixelData[1] + i * linesize[1], static_cast<size_t>(pixelWidth));
-    }
-    return pixel;
-}
-
-uint8_t *VideoDecoder::copyYuv420pData(uint8_t **pixelData, int *linesize, int pixelWidth, int pixelHeight)
-{
-    uint8_t *pixel = new uint8_t[pixelHeight * pixelWidth * 3 / 2];
-    int halfWidth = pixelWidth >> 1;
-    int halfHeight = pixelHeight >> 1;
-    uint8_t *y = pixel;
-    uint8_t *u = pixel + pixelWidth * pixelHeight;
-    uint8_t *v = pixel + pixelWidth * pixelHeight + halfWidth * halfHeight;
-    for (int i = 0; i < pixelHeight; i++)
-    {
-        memcpy(y + i * pixelWidth, pixelData[0] + i * linesize[0], static_cast<size_t>(pixelWidth));
-    }
-    for (int i = 0; i < halfHeight; i++)
-    {
-        memcpy(u + i * halfWidth, pixelData[1] + i * linesize[1], static_cast<size_t>(halfWidth));
-    }
-    for (int i = 0; i < halfHeight; i++)
-    {
-        memcpy(v + i * halfWidth, pixelData[2] + i * linesize[2], static_cast<size_t>(halfWidth));
-    }
-    return pixel;
-}
-
-uint8_t *VideoDecoder::copyDefaultData(AVFrame *frame)
-{
-    AVFrameUniquePtr dstFrame = transFrameToDstFmt(frame, frame->width, frame->height, AV_PIX_FMT_YUV420P);
-    return copyYuv420pData(dstFrame.get()->data, frame->linesize, frame->width, frame->height);
-}
-
 AVFrame *VideoDecoder::transFrameToRGB24(AVFrame *srcFrame, int pixelWidth, int pixelHeight)
 {
     AVFrame *frameRGB = av_frame_alloc();
@@ -829,20 +1760,23 @@ AVFrame *VideoDecoder::transFrameToRGB24(AVFrame *srcFrame, int pixelWidth, int
 AVFrame *VideoDecoder::transFrameToDstFmt(AVFrame *srcFrame, int pixelWidth, int pixelHeight, AVPixelFormat dstFormat)
 {
     AVFrame *dstFrame = av_frame_alloc();
-    SwsContext *swsContext = sws_getContext(pixelWidth, pixelHeight, AVPixelFormat(srcFrame->format),
-                                            pixelWidth, pixelHeight, dstFormat,
-                                            SWS_BILINEAR, NULL, NULL, NULL);
-
-    int numBytes = av_image_get_buffer_size(dstFormat, pixelWidth, pixelHeight, 1);
-    uint8_t *buffer = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
-
-    av_image_fill_arrays(dstFrame->data, dstFrame->linesize, buffer, dstFormat, pixelWidth, pixelHeight, 1);
-
-    sws_scale(swsContext, srcFrame->data, srcFrame->linesize, 0, pixelHeight, dstFrame->data, dstFrame->linesize);
+    swsContext = sws_getCachedContext(swsContext, pixelWidth, pixelHeight, AVPixelFormat(srcFrame->format),
+                                      pixelWidth, pixelHeight, dstFormat,
+                                      SWS_BILINEAR, NULL, NULL, NULL);
 
     dstFrame->format = dstFormat;
     dstFrame->width = pixelWidth;
     dstFrame->height = pixelHeight;
+    // 池化的引用计数缓冲, 随av_frame_free归还帧缓冲池
+    if (swsContext == nullptr || FrameBufferPool::instance()->getFrameBuffer(dstFrame) < 0)
+    {
+        qDebug() << "transFrameToDstFmt fail";
+        av_frame_free(&dstFrame);
+        return nullptr;
+    }
+
+    TraceSpan span("copy");
+    sws_scale(swsContext, srcFrame->data, srcFrame->linesize, 0, pixelHeight, dstFrame->data, dstFrame->linesize);
     return dstFrame;
 }
 
@@ -905,6 +1839,9 @@ void Decoder::debugError(FFMPEG_INIT_ERROR error)
     case FFMPEG_INIT_ERROR::INIT_SW_RENDERER_CONTEXT:
         qDebug() << "init sw renderer context error";
         break;
+    case FFMPEG_INIT_ERROR::OPEN_CANCELED:
+        qDebug() << "open canceled";
+        break;
     default:
         break;
     }
@@ -1,4 +1,12 @@
 #pragma once
+#include "AudioRingBuffer.h"
+#include "FrameQueue.h"
+#include "GopCache.h"
+#include "KeyframeIndex.h"
+#include "MediaClock.h"
+#include "PacketQueue.h"
+#include "PipelineStats.h"
+#include "PlayerControl.h"
 #include <QAudioOutput>
 #include <QDebug>
 #include <QIODevice>
@@ -7,6 +15,9 @@
 #include <QScopedPointer>
 #include <QSharedPointer>
 #include <QThread>
+#include <atomic>
+#include <cmath>
+#include <vector>
 
 extern "C"
 {
@@ -19,6 +30,7 @@ extern "C"
 
 class AudioDecoder;
 class VideoDecoder;
+class Demuxer;
 class AVPacketUniquePtr;
 
 #ifndef QMETATYPEID_DECODER
@@ -30,25 +42,66 @@ class AVPacketUniquePtr;
 class Decoder : public QObject
 {
     Q_OBJECT
-signals:
-    void getCurPts(double &pts);
+public:
+    struct MediaInfo; // 定义见下方
 
+signals:
     void startPlay();
     void playOver();
 
     void initAudioOutput(int sampleRate, int channels);
     void initVideoOutput(int format);
+    // 打开媒体后通知视频同步线程重置同步状态
+    void initClock();
+    // 跳转/重新开始时通知音频输出丢弃已解码未播放的数据, serial为清空后音频包队列的serial, 之前的数据均作废
+    void flushAudio(int serial);
 
     void sendAudioPacket(AVPacket *packet);
     void sendVideoPacket(AVPacket *packet);
 
+    // 启动音频/视频解码线程中的解码循环
+    void startAudioDecode();
+    void startVideoDecode();
+    // 暂停时前进一帧: 视频解码线程补解一帧, 视频同步线程输出一帧
+    void stepVideo();
+    // 暂停时拖动预览: 视频解码线程解码跳转后的第一个关键帧
+    void scrubVideo();
+    // 画面已离开解码位置(后退/倒放过)时暂停逐帧, direction为1/-1: 视频解码线程从GOP缓存送出相邻帧, 视频同步线程在其送达后输出
+    // fromDisplayed为true时以当前显示的帧为起点
+    void stepVideoCached(int direction, bool fromDisplayed);
+    // 暂停时倒放: 视频解码线程倒序送出帧, 视频同步线程按时间戳间隔输出
+    void reverseVideo(bool fromDisplayed);
+    // 执行命令后播放状态发生变化, 音频输出据此挂起/恢复设备
+    void stateChanged(int state);
+
+    // 异步打开媒体: serial为openAsync的返回值, 界面据此忽略已被取代的打开请求
+    // 打开进度, stage为OPEN_STAGE
+    void openProgress(int serial, int stage);
+    // 打开完成, 已开始解复用, 可投递播放命令
+    void mediaReady(int serial, const Decoder::MediaInfo &info);
+    // 打开失败或被取消, error为FFMPEG_INIT_ERROR
+    void openFailed(int serial, int error);
+    // 内部使用: 将打开请求排队到解码线程
+    void openRequested(const QString &filePath, int serial);
+    // 内部使用: 请求索引线程建立关键帧索引
+    void buildKeyframeIndex(const QString &filePath, int streamIndex, int serial);
+
 public slots:
-    // 响应拖动进度条, 跳转到帧并返回这一帧画面
-    void setCurFrame(int64_t _curFrame);
+    // 执行控制命令队列中的所有命令, 界面线程投递命令后通知
+    void processCommands();
 
     // 开始播放
     void decodePacket();
 
+private slots:
+    void onVideoDecodeEnd();
+    // 倒放已到第一帧
+    void onReverseEnd();
+    // 在解码线程中执行打开请求, 已被新请求取代时直接放弃
+    void onOpenRequested(const QString &filePath, int serial);
+    // 后台索引建立完成, 仍是当前媒体时加载
+    void onKeyframeIndexBuilt(const QString &filePath, int streamIndex);
+
 public:
     enum FFMPEG_INIT_ERROR
     {
@@ -62,6 +115,44 @@ public:
         INIT_VIDEO_CODEC_CONTEXT_ERROR,
         INIT_RESAMPLER_CONTEXT_ERROR,
         INIT_SW_RENDERER_CONTEXT,
+        OPEN_CANCELED,
+    };
+
+    // 打开媒体的阶段, 按执行顺序
+    enum OPEN_STAGE
+    {
+        OPEN_INPUT,        // avformat_open_input, 网络流包括建立连接
+        OPEN_PROBE,        // avformat_find_stream_info, 大文件/慢速源耗时最长
+        OPEN_AUDIO_CODEC,  // 打开音频解码器与重采样器
+        OPEN_VIDEO_CODEC,  // 打开视频解码器, 包括创建硬件设备
+    };
+
+    // 流参数探测方式, 探测缓存命中时两者都不探测
+    enum PROBE_MODE
+    {
+        PROBE_FULL, // 按ffmpeg默认预算完整探测
+        PROBE_FAST, // 先以小预算探测, 参数不全时再完整探测
+    };
+
+    // 打开完成后的媒体信息, 随mediaReady发出
+    struct MediaInfo
+    {
+        QString filePath;
+        int mediaType{UNKNOWN}; // FFMPEG_MEDIA_TYPE
+        int64_t durationMs{-1};
+        QString formatName;
+        QString probeResult; // 参数来源: cache, fast, full
+        double openMs{0.0};  // 打开耗时, 含清理上一个媒体
+
+        QString audioCodec; // 无音频流时为空
+        int sampleRate{0};
+        int channels{0};
+
+        QString videoCodec; // 无视频流时为空
+        int width{0};
+        int height{0};
+        double frameRate{0.0};
+        QString hwDevice; // 硬解设备类型名, 软解时为空
     };
 
     enum FFMPEG_MEDIA_TYPE
@@ -72,16 +163,50 @@ public:
         MULTI_AUDIO_VIDEO,
     };
 
+    // 解码线程策略
+    enum THREAD_POLICY
+    {
+        THREAD_AUTO,  // 按核数, 分辨率, 编码器自动选择线程数与类型
+        THREAD_FRAME, // 帧级多线程, 吞吐最高, 但每多一个线程增加一帧解码延迟
+        THREAD_SLICE, // 片级多线程, 不增加延迟, 加速效果取决于码流分片数
+        THREAD_FIXED, // 固定线程数, 线程类型由ffmpeg按编码器能力决定
+    };
+
+    struct ThreadConfig
+    {
+        THREAD_POLICY policy;
+        int threadCount; // 0表示自动选择线程数(THREAD_FIXED时必须大于0)
+    };
+
 private:
     QList<AVHWDeviceType> devices; // 设备支持的硬解码器, 在类初始化时遍历获取
 
     AVFormatContext *formatContext; // 用于处理媒体文件格式的结构, 包含了许多用于描述文件格式和元数据的信息
 
+    // 音频/视频解码器各自运行在独立线程中, 从各自的包队列取包解码
     AudioDecoder *audioDecoder{nullptr};
     VideoDecoder *videoDecoder{nullptr};
-
-    QQueue<AVPacket *> audioPacketQueue;
-    QQueue<AVPacket *> videoPacketQueue;
+    QThread *audioDecodeThread{nullptr};
+    QThread *videoDecodeThread{nullptr};
+
+    // 由解复用线程写入的有界包队列
+    PacketQueue audioPacketQueue;
+    PacketQueue videoPacketQueue;
+    // 视频解码线程写入, 视频同步线程读取的有界解码帧队列
+    FrameQueue videoFrameQueue;
+    // 音频解码线程写入, 音频输出读取的PCM环形缓冲, 由音频输出按协商的格式分配
+    AudioRingBuffer audioRingBuffer;
+    // 音视频同步时钟, 音频输出/视频同步线程设置, 各线程无锁读取
+    MediaClock mediaClock;
+
+    Demuxer *demuxer{nullptr};
+    QThread *demuxThread{nullptr};
+
+    // 关键帧索引, 只在解码线程访问; 没有索引文件时由索引线程在后台建立
+    QString mediaPath;
+    KeyframeIndex keyframeIndex;
+    KeyframeIndexer *keyframeIndexer{nullptr};
+    QThread *indexThread{nullptr};
 
     // AVPacket packet;
     FFMPEG_MEDIA_TYPE mediaType;
@@ -91,12 +216,40 @@ private:
     int defaltStreamIndex; // 默认流索引
     double defalt_time_base_q2d_ms;
 
-    double curPts = 0.0;
+    PlayerControl *control; // 播放状态与控制命令, 本类为命令的执行方
+
+    ThreadConfig audioThreadConfig{THREAD_AUTO, 0};
+    ThreadConfig videoThreadConfig{THREAD_AUTO, 0};
+    double videoThreadLatencyMs{0.0}; // 帧级多线程带来的额外解码延迟
+
+    // 打开请求序号: openSerial为最新请求, openingSerial为正在打开的请求(未在打开时为0)
+    // 两者不同时说明正在进行的打开已被取代或取消, 由中断回调终止阻塞中的ffmpeg调用
+    std::atomic<int> openSerial{0};
+    std::atomic<int> openingSerial{0};
 
-    const int *m_type; // 控制播放状态
+    bool exactSeek{true}; // 跳转到目标时间而非目标之前的关键帧
+    bool stepDetached{false}; // 显示的帧由后退/倒放从GOP缓存取得, 与解码位置无关; 恢复播放时从该帧重新跳转
+
+    PROBE_MODE probeMode{PROBE_FAST};
+    bool probeCacheEnabled{true};
+    QString probeResult; // 最近一次打开的参数来源
+    double openMs{0.0};  // 最近一次打开的耗时
+
+    // 清理当前媒体并打开新媒体, 成功后开始解复用; 返回FFMPEG_INIT_ERROR
+    int openMedia(const QString &filePath, int serial);
+    bool isOpenCanceled() const;
+    // AVIOInterruptCB回调, 返回非0时ffmpeg中止当前阻塞操作
+    static int interruptCallback(void *opaque);
+    MediaInfo collectMediaInfo(const QString &filePath) const;
+    // 加载媒体的关键帧索引, 没有时请求后台建立
+    void loadKeyframeIndex();
 
     // 初始化
     int initFFmpeg(const QString &filePath);
+    // 打开输入并设置中断回调, 失败抛出FFMPEG_INIT_ERROR
+    void openInput(const QString &filePath);
+    // 取得各流的解码参数: 依次尝试探测缓存, 快速探测, 完整探测; 失败抛出FFMPEG_INIT_ERROR
+    void probeStreams(const QString &filePath);
 
     // 音频相关结构体初始化, 成功返回audioStreamIndex, 无音频流返回-1, 失败抛出FFMPEG_INIT_ERROR
     int initAudioDecoder();
@@ -107,26 +260,63 @@ private:
 
     // AVCodecContext *getCudaDecoder
     int initCodec(AVCodecContext **codecContext, AVCodecParameters *codecParameters, const AVCodec *codec);
+    // 按线程策略设置thread_count/thread_type, 需在avcodec_open2之前调用
+    void applyThreadConfig(AVCodecContext *codecContext, const AVCodec *codec);
+    // 自动模式下的线程数: 由核数, 分辨率, 编码器决定
+    int autoThreadCount(const AVCodecContext *codecContext) const;
 
     void clean();
     void clearPacketQueue();
 
+    // 执行一条命令并确认
+    void runCommand(const PlayerCommand &command);
+    void applyCommand(const PlayerCommand &command);
+    // 跳转到pts_ms(ms), 旧数据按serial失效, 无需先暂停解码; exact为false时从目标之前的关键帧开始
+    void seekTo(int64_t pts_ms, bool exact);
+    // 开始后退/倒放时放弃解码位置, 返回是否由此刚离开
+    bool detachVideo();
+    void stopReverse();
+
     void debugError(FFMPEG_INIT_ERROR error);
 
-    void decodeAudio();
     void decodeVideo();
-    void decodeMultMedia();
 
 public:
-    explicit Decoder(const int *_type, QObject *parent = nullptr);
+    explicit Decoder(PlayerControl *control, QObject *parent = nullptr);
     ~Decoder();
 
+    // 同步打开, 阻塞调用线程直到打开完成; 用于没有事件循环等待结果的场合
     void setVideoPath(const QString &filePath);
+    // 异步打开, 任意线程调用, 立即返回本次请求的序号; 结果由mediaReady/openFailed通知
+    // 新请求会取消尚未完成的旧请求
+    int openAsync(const QString &filePath);
+    // 取消尚未完成的打开, 任意线程调用
+    void cancelOpen();
+    static QString openStageName(int stage);
+    // 精确跳转: 从关键帧解码到目标时间, 目标之前的帧不转换不显示; 关闭时从目标之前的关键帧开始播放
+    void setExactSeek(bool enabled);
+    // 设置探测方式与是否使用探测缓存, 在下一次打开媒体时生效; 需在打开请求之前调用
+    void setProbeMode(PROBE_MODE mode);
+    void setProbeCacheEnabled(bool enabled);
+    // 当前媒体已加载的关键帧数, 未加载索引时为0
+    int64_t getKeyframeIndexCount() const { return keyframeIndex.count(); }
+    // 最近一次打开的参数来源(cache, fast, full)与耗时(ms)
+    QString getProbeResult() const { return probeResult; }
+    double getOpenMs() const { return openMs; }
 
     bool resume();
 
+    // 设置音频/视频流的解码线程策略, 在下一次打开媒体时生效
+    void setThreadConfig(AVMediaType type, THREAD_POLICY policy, int threadCount = 0);
+    // 当前视频解码器帧级多线程引入的延迟(ms), 低延迟场景可据此改用THREAD_SLICE
+    double getVideoThreadLatencyMs() const { return videoThreadLatencyMs; }
+
+    FFMPEG_MEDIA_TYPE getMediaType() const { return mediaType; }
     AudioDecoder *getAudioDecoder() const { return audioDecoder; }
     VideoDecoder *getVideoDecoder() const { return videoDecoder; }
+    FrameQueue *getVideoFrameQueue() { return &videoFrameQueue; }
+    AudioRingBuffer *getAudioRingBuffer() { return &audioRingBuffer; }
+    MediaClock *getMediaClock() { return &mediaClock; }
 
     // 得到总音频帧数
     int64_t getAudioFrameCount() const;
@@ -139,32 +329,74 @@ public:
     QList<QString> getSupportedHwDecoderNames();
 };
 
+Q_DECLARE_METATYPE(Decoder::MediaInfo)
+
 class AudioDecoder : public QObject
 {
     friend class Decoder;
     Q_OBJECT
 signals:
-    void sendAudioBuffer(uint8_t *audioBuffer, int bufferSize, double pts);
+    // 已向环形缓冲写入bufferSize字节, 其起始时间戳为pts(ms), serial为解出这些数据的包的serial
+    void sendAudioBuffer(int bufferSize, double pts, int serial);
+
+    // 音频流解码完毕
+    void decodeEnd();
+
+public slots:
+    // 解码循环, 运行在音频解码线程, 直到暂停/停止或流结束
+    void decodeLoop();
 
 private:
+    PacketQueue *packetQueue;
+    AudioRingBuffer *ringBuffer;
+    MediaClock *mediaClock;
+    const PlayerControl *control; // 控制播放状态
+    QMutex loopMutex;  // 解码循环运行期间持有, 释放解码器前借此等待循环退出
+
     AVCodecContext *codecContext{nullptr};
     SwrContext *swrContext{nullptr};
 
+    // 重采样输出缓冲, 打开媒体时按采样率/声道数分配一次, 播放中不再分配
+    std::vector<uint8_t> pcmBuffer;
+    int pcmBufferSamples{0};
+    int pcmBytesPerSample{0}; // 所有声道一个采样点的字节数
+    size_t ringFillBytes{0};  // 环形缓冲中已缓存超过此字节数时暂停写入
+
     int audioStreamIndex;
 
     double time_base_q2d_ms;
 
     double lastPts = -1.0;
+    int packetSerial = -1; // 最近解码的包所属serial, 变化时需刷新解码器
+    double decodeMs{0.0};  // 当前包送入与取帧的累计耗时, 不含写入环形缓冲的等待
+    int receivedFrames{0}; // 当前包送入后取出的帧数
+
+    // 精确跳转目标(ms), 由Decoder在清空包队列前写入, 取到新serial的包时读入seekTargetMs; NAN表示不裁剪
+    std::atomic<double> pendingSeekTargetMs{NAN};
+    double seekTargetMs{NAN};
+
+    // 音频不为主时钟时, 音频时钟与主时钟之差的加权累计, 用于平滑后决定重采样补偿
+    double audioDiffCum{0.0};
+    int audioDiffAvgCount{0};
 
     void clean();
 
+    // 取出解码器中所有已解码帧, 直到需要新输入(EAGAIN)或已冲刷完毕(EOF)
+    void receiveFrames();
+    // 音频不为主时钟时按与主时钟的偏差返回该帧应输出的采样点数, 否则返回nbSamples
+    int synchronizeAudio(int nbSamples);
+    // 写入环形缓冲, 已缓存足够或空间不足时挂起至音频输出消费; 停止播放或已跳转时放弃并返回false
+    // written输出实际写入的字节数, 放弃时已写入的部分也须通知音频输出, 以保持其字节位置与环形缓冲一致
+    bool writeToRingBuffer(const uint8_t *data, int size, int *written);
+
 public:
-    AudioDecoder(QObject *parent = nullptr) : QObject(parent) {}
+    AudioDecoder(PacketQueue *packetQueue, AudioRingBuffer *ringBuffer, MediaClock *mediaClock, const PlayerControl *control, QObject *parent = nullptr)
+        : QObject(parent), packetQueue(packetQueue), ringBuffer(ringBuffer), mediaClock(mediaClock), control(control) {}
     ~AudioDecoder() = default;
 
-    // 将音频帧转换为 PCM 格式
-    // 返回值: 转换后音频数据的大小
-    int transferFrameToPCM(AVFrame *frame, uint8_t *dstBuffer);
+    // 将音频帧转换为 PCM 格式写入pcmBuffer, frame为空时取出重采样器中剩余的数据
+    // 返回值: 转换出的采样点数
+    int transferFrameToPCM(AVFrame *frame);
 
     void decodeAudioPacket(AVPacketUniquePtr packet);
 };
@@ -173,11 +405,50 @@ class VideoDecoder : public QObject
 {
     friend class Decoder;
     Q_OBJECT
+public:
+    // 解码持续落后主时钟时逐级降低解码开销, 追上后逐级恢复
+    enum SKIP_LEVEL
+    {
+        SKIP_NONE,        // 正常解码
+        SKIP_NONREF,      // 跳过非参考帧(skip_frame = AVDISCARD_NONREF)
+        SKIP_LOOP_FILTER, // 另跳过所有帧的环路滤波(skip_loop_filter = AVDISCARD_ALL), 画质下降
+    };
+
+    static constexpr int64_t DEFAULT_GOP_CACHE_BYTES = 256LL * 1024 * 1024; // GOP缓存默认预算, 1080p约85帧
+
 signals:
-    void sendVideoFrame(uint8_t *pixelData, int pixelWidth, int pixelHeight, double pts);
+    // 视频流解码完毕
+    void decodeEnd();
+    // 拖动预览帧已送入帧队列
+    void scrubFrameReady();
+    // 从GOP缓存取得的逐帧画面已送入帧队列
+    void stepFrameReady();
+    // 倒放已送出第一帧
+    void reverseEnd();
+    // 暂停时的单帧解码已结束: 已送出一帧, 或已到流末尾/离开暂停状态
+    void stepDecoded();
+
+public slots:
+    // 解码循环, 运行在视频解码线程, 直到暂停/停止
+    void decodeLoop();
+    // 暂停时解码并送出一帧
+    void decodeStep();
+    // 拖动预览: 只解码最新预览请求跳转后的第一个关键帧并送出, 已预览过或被跳转/播放取代时直接返回
+    void decodeScrub();
+    // 从GOP缓存取stepTimestamp的前一帧/后一帧(direction为-1/1)送出, 未缓存时解码所在的GOP; 已到第一帧/最后一帧时重新送出当前帧
+    void decodeStepCached(int direction, bool fromDisplayed);
+    // 倒放循环, 从GOP缓存逐帧向前送出, 直到倒放结束, 离开暂停状态或到达第一帧
+    void decodeReverse(bool fromDisplayed);
 
 private:
+    PacketQueue *packetQueue;
+    FrameQueue *frameQueue;
+    const MediaClock *mediaClock; // 判断解码是否落后主时钟
+    const PlayerControl *control; // 控制播放状态
+    QMutex loopMutex;  // 解码循环运行期间持有, 释放解码器前借此等待循环退出
+
     AVCodecContext *codecContext{nullptr};
+    SwsContext *swsContext{nullptr}; // 像素格式转换, 尺寸/格式不变时复用
 
     AVBufferRef *hw_device_ctx = nullptr;
     enum AVPixelFormat hw_device_pix_fmt = AV_PIX_FMT_NONE;
@@ -188,20 +459,88 @@ private:
     double time_base_q2d_ms;
 
     double lastPts = -1.0;
+    int packetSerial = -1;       // 最近解码的包所属serial, 变化时需刷新解码器
+    int64_t deliveredFrames{0}; // 已送入帧队列的帧数, 单帧步进据此判断是否已解出一帧
+
+    // 落后处理, 仅视频解码线程访问
+    int lateInRow{0};    // 连续解出即已落后主时钟超过一帧的帧数
+    int onTimeInRow{0};  // 连续解出时仍领先主时钟的帧数
+    int droppedInRow{0}; // 连续丢弃的帧数
+    int receivedFrames{0}; // 当前包送入后取出的帧数
+    double decodeMs{0.0};  // 当前包送入与取帧的累计耗时, 不含格式转换与帧队列等待
+
+    std::atomic<int> skipLevel{SKIP_NONE};
+    std::atomic<int64_t> droppedLateFrames{0}; // 解出后因已落后而在格式转换前丢弃的帧数
+    std::atomic<int64_t> skippedFrames{0};     // 降级期间解码器未输出帧的包数, 近似为被跳过的帧数
+
+    // 精确跳转目标(ms), 由Decoder在清空包队列前写入, 取到新serial的包时读入seekTargetMs; NAN表示不丢弃
+    std::atomic<double> pendingSeekTargetMs{NAN};
+    double seekTargetMs{NAN};
+    AVFrame *seekHeldFrame{nullptr};             // 最近丢弃的目标前的帧, 目标在流末尾之后时显示此帧
+    std::atomic<int64_t> seekDiscardedFrames{0}; // 精确跳转中解码后丢弃的帧数
+
+    // 拖动预览: scrubSerial为最新预览请求跳转后包的最小serial, 由Decoder写入, -1表示没有预览请求
+    // scrubbedSerial为最近送出预览帧的包serial, 不小于scrubSerial说明最新请求已预览
+    std::atomic<int> scrubSerial{-1};
+    int scrubbedSerial{-1};
+    // 预览被取代时已取出的包, 留给之后的解码; 按serial判断是否已失效
+    AVPacket *heldPacket{nullptr};
+    int heldPacketSerial{0};
+
+    // 逐帧后退/倒放, 仅视频解码线程访问
+    // 播放与步进解出的帧同时存入缓存(共享帧数据, 不拷贝), 暂停后后退一般可直接命中; 未命中时由独立的解码器补解
+    QString mediaPath; // GOP解码器打开的文件, 由Decoder在打开媒体后写入
+    GopCache gopCache{DEFAULT_GOP_CACHE_BYTES};
+    GopDecoder gopDecoder;
+    int64_t cachedTimestamp{AV_NOPTS_VALUE}; // 最近存入缓存的帧, 下一帧与之相邻; 丢帧/跳转后为AV_NOPTS_VALUE
+    int64_t stepTimestamp{AV_NOPTS_VALUE};   // 逐帧/倒放最近送出的帧, AV_NOPTS_VALUE表示以视频时钟对应的帧为准
+    std::atomic<int64_t> gopCacheHits{0};
+    std::atomic<int64_t> gopCacheMisses{0};
 
     void clean();
+    // 重置落后处理状态, 恢复正常解码
+    void resetDropPolicy();
+    void setSkipLevel(int level);
+    // 结束精确跳转, 恢复降级等级对应的skip_frame
+    void endExactSeek();
+    // 按该帧落后主时钟的程度调整降级等级, 落后超过一帧时返回true表示应丢弃
+    bool checkLate(double framePts);
+
+    // 渲染器支持的格式: 硬解NV12, 软解YUV420P
+    AVPixelFormat outputFormat() const;
+    // 当前显示帧的时间戳(流时间基), 由视频时钟反算
+    int64_t displayedTimestamp() const;
+    // 与timestamp相邻的前一帧/后一帧(direction为-1/1), 未缓存时解码所在的GOP; 没有时返回AV_NOPTS_VALUE
+    int64_t cachedNeighbor(int64_t timestamp, int direction);
+    // 将缓存中的帧送入帧队列, 未缓存或帧队列中止时返回false
+    bool pushCachedFrame(int64_t timestamp, int serial);
+
+    // 取一个包, 先取预览留下的包; 队列中止时返回nullptr
+    AVPacket *popPacket(int *serial);
+    // 取一个包解码, 队列中止时返回false, 取到结束包时置eof
+    bool decodeNextPacket(bool *eof);
+    // 取出解码器中所有已解码帧送入帧队列, 直到需要新输入(EAGAIN)或已冲刷完毕(EOF); 帧队列中止时返回false
+    bool receiveFrames();
+    // 转为渲染器支持的格式(硬解NV12, 软解YUV420P)后送入帧队列
+    bool deliverFrame(AVFrame *frame);
 
     // 将硬件解码后的数据拷贝到内存中(但部分数据会消失, 例如pts)
     void transferDataFromHW(AVFrame **frame);
 
-    uint8_t *copyNv12Data(uint8_t **pixelData, int *linesize, int pixelWidth, int pixelHeight);
-    uint8_t *copyYuv420pData(uint8_t **pixelData, int *linesize, int pixelWidth, int pixelHeight);
-    uint8_t *copyDefaultData(AVFrame *rawFrame);
-
 public:
-    VideoDecoder(QObject *parent = nullptr) : QObject(parent) {}
+    VideoDecoder(PacketQueue *packetQueue, FrameQueue *frameQueue, const MediaClock *mediaClock, const PlayerControl *control, QObject *parent = nullptr)
+        : QObject(parent), packetQueue(packetQueue), frameQueue(frameQueue), mediaClock(mediaClock), control(control), gopDecoder(control) {}
     ~VideoDecoder() = default;
 
+    SKIP_LEVEL getSkipLevel() const { return static_cast<SKIP_LEVEL>(skipLevel.load()); }
+    int64_t getDroppedLateFrames() const { return droppedLateFrames; }
+    int64_t getSkippedFrames() const { return skippedFrames; }
+    int64_t getSeekDiscardedFrames() const { return seekDiscardedFrames; }
+    // GOP缓存预算, 任意线程调用; 0表示不保留播放解出的帧, 每次后退都重新解码所在的GOP
+    void setGopCacheBudget(int64_t bytes) { gopCache.setBudget(bytes); }
+    int64_t getGopCacheHits() const { return gopCacheHits; }
+    int64_t getGopCacheMisses() const { return gopCacheMisses; }
+
     void decodeVideoPacket(AVPacketUniquePtr packet);
 
     AVFrame *transFrameToRGB24(AVFrame *frame, int pixelWidth, int pixelHeight);
@@ -1,3 +1,4 @@
+#include "TraceWriter.h"
 #include "demo.h"
 #include <QAPPlication>
 
@@ -6,7 +7,12 @@ int main(int argc, char *argv[])
     // QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QApplication a(argc, argv);
 
+    // 设置环境变量PLAYER_TRACE=<文件>时记录流水线时间线, 退出时写出
+    TraceWriter::instance()->startFromEnvironment();
+
     demo w;
     w.show();
-    return a.exec();
+    int ret = a.exec();
+    TraceWriter::instance()->stop();
+    return ret;
 }